@@ -6,6 +6,18 @@ using namespace peq;
 using namespace peq::network;
 using namespace peq::http;
 
+// counts uploaded bytes without keeping them in memory
+class CountingStream : public BodyStream
+{
+public:
+	bool write(const char*, size_t length) override
+	{
+		bytes += length;
+		return true;
+	}
+	size_t bytes = 0;
+};
+
 class ApiSession : public HttpSession
 {
 public:
@@ -25,6 +37,25 @@ public:
 		{
 			return Response::createText(Status::OK, "POST TEST");
 		})
+		// path captures, {name} matches any segment and {name:int} only integers
+		.set(Method::GET, "/api/users/{id:int}", [](const Request&, const Parameters& path) -> Response
+		{
+			return Response::createText(Status::OK, "USER " + std::to_string(path.i("id")));
+		})
+		.set(Method::GET, "/api/users/{name}/posts", [](const Request&, const Parameters& path) -> Response
+		{
+			return Response::createText(Status::OK, "POSTS " + path.s("name"));
+		})
+		// body is streamed in chunks as it arrives instead of collected to req.body
+		.setStream(Method::POST, "/api/upload", [](const Request&, const Parameters&) -> std::shared_ptr<BodyStream>
+		{
+			return std::make_shared<CountingStream>();
+		},
+		[](const Request& req, const Parameters&) -> Response
+		{
+			auto stream = std::static_pointer_cast<CountingStream>(req.bodyStream);
+			return Response::createText(Status::OK, "UPLOADED " + std::to_string(stream->bytes));
+		})
 		.setDefault([](const Request& req) -> Response
 		{
 			return Response::createText(Status::BadRequest, "Bad");
@@ -41,9 +72,26 @@ public:
 	}
 	void httpRequestAvailable(const Request& http) override
 	{
+		if (http.method == Method::GET && http.url.path == "/api/export")
+		{
+			// body is written in chunks as it is produced, no Content-Length needed
+			auto resp = Response::create(Status::OK, "csv");
+			beginChunked(resp);
+			for (int i = 0; i < 1000; i++)
+			{
+				auto line = std::to_string(i) + ",row " + std::to_string(i) + "\n";
+				sendChunk(line.c_str(), line.size());
+			}
+			endChunked();
+			return;
+		}
 		Response resp = _router.route(http);
 		send(resp);
 	}
+	std::shared_ptr<BodyStream> httpBodyStream(const Request& http) override
+	{
+		return _router.stream(http);
+	}
 	void disconnected() override
 	{
 		std::cout << "http session disconnected" << std::endl;
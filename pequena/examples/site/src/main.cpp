@@ -30,19 +30,9 @@ public:
 	void httpRequestAvailable(const Request& http) override
 	{
 		std::cout << "GET: " << http.url.path << std::endl;
-		// get filepath based on url
-		auto file = s_httpRoot.getPath(http.url.path);
-		if (file.empty())
-		{
-			// No file, send NotFound
-			send(Response(Status::NotFound));
-		}
-		else
-		{
-			// file exists, load & send
-			auto content = s_httpRoot.get(file);
-			send(Response::createFromFilename(Status::OK, file, std::move(content)));
-		}
+		// file based on url, NotFound if there is no such file.
+		// Cached files are sent from memory, others straight from disk
+		send(s_httpRoot.response(http));
 	}
 	void disconnected() override
 	{
@@ -54,6 +44,11 @@ int main() {
 	// initialize network things
 	peq::network::awake();
 
+	// keep up to 64MB of small files in memory
+	s_httpRoot.setCache(64 * 1024 * 1024);
+	// large media libraries: map files instead and let kernel page cache keep them
+	// s_httpRoot.setMode(peq::http::Files::Mode::Mapped);
+
 	peq::network::Server server;
 	server
 		.setPort(8181)
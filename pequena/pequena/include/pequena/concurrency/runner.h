@@ -29,11 +29,13 @@ namespace peq
 				_threadCount = c;
 				return *this;
 			}
-			void start()
+			// arguments are passed to constructor of every task
+			template<typename... Args>
+			void start(Args&&... args)
 			{
 				for (unsigned i = 0; i < _threadCount; i++)
 				{
-					_tasks.push_back(std::make_shared<T>());
+					_tasks.push_back(std::make_shared<T>(args...));
 				}
 				for (unsigned i = 0; i < _threadCount; i++)
 				{
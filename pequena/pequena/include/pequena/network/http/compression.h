@@ -0,0 +1,28 @@
+#pragma once
+
+#include "http.h"
+#include <string>
+
+namespace peq
+{
+	namespace http
+	{
+		enum class Encoding
+		{
+			Identity,
+			Gzip,
+			Deflate
+		};
+
+		// false when library is built without zlib, compress() then always fails
+		bool compressionAvailable();
+		// compresses data, level 1 (fast) - 9 (small). Empty result on failure
+		peq::network::Data compress(Encoding encoding, const char* data, size_t dataLength, int level = 6);
+		// preferred encoding from Accept-Encoding header, gzip wins ties
+		Encoding acceptedEncoding(const Request& request);
+		// Content-Encoding value
+		std::string toString(Encoding encoding);
+		// text formats that shrink when compressed, images and archives do not
+		bool compressible(const std::string& contentType);
+	}
+}
@@ -4,6 +4,10 @@
 #include "pequena/network/network.h"
 #include <string>
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
 #include <filesystem>
 
 namespace peq
@@ -13,14 +17,58 @@ namespace peq
 		class Files
 		{
 		public:
+			enum class Mode
+			{
+				Read,	// files are cached to memory or sent from disk
+				Mapped	// files are mapped and shared by all threads, kernel page cache handles eviction
+			};
 			Files() = default;
 			Files(const std::string& fileRoot);
 			~Files();
 			std::string getPath(const std::string& url) const;
+			// reads whole file to memory, Response::createFromFile sends file without copying
 			peq::network::Data get(const std::string& path) const;
+			// keeps recently used files and their headers in memory, budget in bytes, 0 disables cache.
+			// Files larger than maxFileSize are always sent from disk. Cached files are not reloaded when changed on disk
+			void setCache(size_t budget, size_t maxFileSize = 1024 * 1024);
+			void clearCache();
+			// changed files are mapped again on next request, old mapping must not be truncated while it is being sent
+			void setMode(Mode mode);
+			// response for request url, NotFound when there is no such file.
+			// Clients accepting gzip get precompressed .gz sibling or cached compressed copy of text files
+			Response response(const Request& request) const;
 		private:
+			struct CachedFile
+			{
+				std::string path;
+				std::string headers;
+				peq::network::Data body;
+				peq::network::SharedData mapping;
+				// mapped file size and modification time, mapping is renewed when they change
+				uint64_t size = 0;
+				uint64_t modified = 0;
+				size_t cost() const
+				{
+					return path.size() + headers.size() + body.size();
+				}
+			};
+			using CachedFileRef = std::shared_ptr<const CachedFile>;
+			static Response cachedResponse(const CachedFileRef& file);
+			CachedFileRef cached(const std::string& path, bool gzip) const;
+			CachedFileRef mapped(const std::string& key, const std::string& path, bool gzip) const;
+			void evict() const;
 			std::string _root;
 			std::map<std::string, std::filesystem::path> _paths;
+			std::unordered_set<std::string> _gzipped;
+			mutable std::mutex _cacheMutex;
+			mutable std::list<CachedFileRef> _lru;
+			mutable std::unordered_map<std::string, std::list<CachedFileRef>::iterator> _cache;
+			mutable std::unordered_map<std::string, CachedFileRef> _mapped;
+			mutable std::unordered_set<std::string> _incompressible;
+			mutable size_t _cacheSize = 0;
+			Mode _mode = Mode::Read;
+			size_t _cacheBudget = 0;
+			size_t _cacheMaxFileSize = 0;
 		};
 	}
 }
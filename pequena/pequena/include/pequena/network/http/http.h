@@ -3,8 +3,12 @@
 #include "../network.h"
 #include "lhttp/llhttp.h"
 #include <unordered_set>
+#include <unordered_map>
 #include <vector>
 #include <map>
+#include <regex>
+#include <string_view>
+#include <array>
 
 namespace peq
 {
@@ -142,6 +146,76 @@ namespace peq
 			std::string value;
 		};
 
+		// request headers used by the library, looked up by index instead of scanning names
+		enum class KnownHeader
+		{
+			Authorization,
+			Connection,
+			Cookie,
+			ApiKey,	// x-api-key
+			IfNoneMatch,
+			IfModifiedSince,
+			Range,
+			IfRange,
+			AcceptEncoding,
+			ContentLength,
+			ContentType,
+			Host,
+			Count
+		};
+
+		// cookies of Cookie headers as offsets to header values, built when header is added.
+		// Offsets stay valid when header list is copied or grows, views are made on lookup
+		class CookieJar
+		{
+		public:
+			void add(size_t header, std::string_view value);
+			void clear();
+			// first cookie of name, empty when missing
+			std::string_view find(const std::vector<Header>& headers, std::string_view name) const;
+		private:
+			struct Entry
+			{
+				uint32_t header;
+				uint32_t name;
+				uint32_t nameLength;
+				uint32_t value;
+				uint32_t valueLength;
+			};
+			std::vector<Entry> _cookies;
+		};
+
+		// header list of request, names of known headers are interned when header is added.
+		// Names are matched case-insensitively, first header of same name wins
+		class Headers
+		{
+		public:
+			using const_iterator = std::vector<Header>::const_iterator;
+			void push_back(const Header& header);
+			void push_back(Header&& header);
+			void reserve(size_t count);
+			void clear();
+			size_t size() const;
+			bool empty() const;
+			const_iterator begin() const;
+			const_iterator end() const;
+			const Header& operator[](size_t index) const;
+			// nullptr when request does not have header
+			const Header* find(KnownHeader name) const;
+			const Header* find(std::string_view name) const;
+			// empty when request does not have header
+			const std::string& value(KnownHeader name) const;
+			// value of first cookie of name in Cookie headers, empty when missing
+			std::string_view cookie(std::string_view name) const;
+			// KnownHeader::Count for names that are not known
+			static KnownHeader intern(std::string_view name);
+		private:
+			void index(size_t position);
+			std::vector<Header> _headers;
+			std::array<uint32_t, static_cast<size_t>(KnownHeader::Count)> _index = {};	// position + 1, 0 when missing
+			CookieJar _cookies;
+		};
+
 		struct Version {
 			int major;
 			int minor;
@@ -204,6 +278,9 @@ namespace peq
 			bool b(const std::string& key) const;
 			void set(const std::string& key, const std::string& value);
 			std::vector<std::string> keys() const;
+			// hash of parameter names, same as hashKeys of sorted keys()
+			uint64_t keysHash() const;
+			bool hasKeys(const std::vector<std::string>& sortedKeys) const;
 		private:
 			const std::string& get(const std::string& key) const;
 			std::map<std::string, std::string> _params;
@@ -218,20 +295,78 @@ namespace peq
 			Parameters params;
 		};
 
+		struct ByteRange
+		{
+			uint64_t first;
+			uint64_t last;	// inclusive
+			uint64_t size() const
+			{
+				return last - first + 1;
+			}
+		};
+
+		// receives request body as it arrives instead of Request::body, e.g. to write uploads to disk.
+		// Destroyed without end() when connection is lost
+		class BodyStream
+		{
+		public:
+			virtual ~BodyStream() {}
+			// false aborts request, it is answered with BadRequest and connection is closed
+			virtual bool write(const char* data, size_t length) = 0;
+			// whole body received, called before request handler
+			virtual void end() {}
+		};
+
 		struct Request
 		{
 			Method method;
 			Url url;
 			Version version;
-			std::vector<Header> headers;
+			Headers headers;
 			peq::network::Data body;
+			// set when body was delivered to stream, body is empty then
+			std::shared_ptr<BodyStream> bodyStream;
 			const Authorization auth() const;
 			const Apikey apiKey() const;
 			const Cookie cookie(const std::string& cookie) const;
+			// value of cookie without copying it, empty when missing
+			std::string_view cookieValue(std::string_view cookie) const;
 			peq::network::SocketInfo info;
 			bool secure = false;
 			bool wantsToKeepAlive() const;
 			bool wantsToClose() const;
+			// true when If-None-Match or If-Modified-Since shows client already has this representation
+			bool notModified(const std::string& etag, uint64_t lastModified) const;
+			// Range header resolved against content size, overlapping ranges are merged.
+			// Empty optional when range should be ignored (no header, bad syntax, If-Range mismatch), empty vector when no range is satisfiable
+			std::optional<std::vector<ByteRange>> ranges(uint64_t contentSize, const std::string& etag, uint64_t lastModified) const;
+		};
+
+		struct HeaderView
+		{
+			std::string_view name;
+			std::string_view value;
+		};
+
+		// request without copies, views point to receive arena of session and are valid until httpRequestViewAvailable returns
+		struct RequestView
+		{
+			Method method;
+			Version version;
+			std::string_view url;
+			std::string_view path;
+			std::string_view query;
+			std::vector<HeaderView> headers;
+			std::vector<std::pair<std::string_view, std::string_view>> params;
+			std::string_view body;
+			peq::network::SocketInfo info;
+			bool secure = false;
+			// case-insensitive name, empty when missing
+			std::string_view header(std::string_view name) const;
+			// last value of key, empty when missing
+			std::string_view param(std::string_view key) const;
+			// owning copy, e.g. for Router
+			Request toRequest() const;
 		};
 
 		struct Response
@@ -240,6 +375,8 @@ namespace peq
 			static Response createText(Status status, const std::string& content);
 			static Response createJson(Status status, const std::string& content);
 			static Response createFromFilename(Status status, const std::string& filename, peq::network::Data&& content);
+			// body is sent from file without reading it to memory, NotFound if file can not be opened
+			static Response createFromFile(Status status, const std::string& filename);
 			static Response create(Status status, const std::string& type, peq::network::Data&& content);
 			static Response create(Status status, const std::string& type);
 			Response() {}
@@ -250,68 +387,187 @@ namespace peq
 			http::Version version;
 			std::vector<Header> headers;
 			peq::network::Data body;
+			// serialized header lines ("Name: value\r\n") sent after headers, shared by cached responses
+			peq::network::SharedData preparedHeaders;
+			// sent after body when set, owner keeps data alive
+			peq::network::SharedData sharedBody;
+			// sent after body when set
+			peq::network::FileRange file;
 		};
 
+		// http date format used by Date and Last-Modified headers
+		std::string formatDate(uint64_t epochSeconds);
+		// seconds since epoch from http date, 0 when date can not be parsed
+		uint64_t parseDate(const std::string& date);
+		// changes when file is modified, suffix separates encoded representations of same file
+		std::string fileETag(const peq::network::File& file, const std::string& suffix = "");
+
 		class Router
 		{
 		public:
 			Router& setDefault(std::function<Response(const Request&)> func);
+			// route is path with optional segment captures ("/users/{id:int}/{name}") and query parameter names ("?sort=string").
+			// Paths with other regex syntax are matched with std::regex after compiled routes
 			Router& set(Method method, const std::string& route,
 				std::function<Response(const Request&)> func, std::function<bool(const http::Request&)> authFunc = nullptr);
+			// as set, func gets segment captures of route such as /users/{id:int} as second argument
+			Router& set(Method method, const std::string& route,
+				std::function<Response(const Request&, const Parameters&)> func, std::function<bool(const http::Request&)> authFunc = nullptr);
+			// as set, body is written to stream created by streamFunc and func finds it in Request::bodyStream
+			Router& setStream(Method method, const std::string& route,
+				std::function<std::shared_ptr<BodyStream>(const Request&, const Parameters&)> streamFunc,
+				std::function<Response(const Request&, const Parameters&)> func, std::function<bool(const http::Request&)> authFunc = nullptr);
 			Response route(const Request& request);
+			// body stream of matching stream route, called from HttpSession::httpBodyStream when headers are received.
+			// nullptr when route does not stream or request is not authorized
+			std::shared_ptr<BodyStream> stream(const Request& request) const;
 		private:
 			struct Handle
 			{
 				std::string path;
 				Method method;
-				std::function<Response(const Request&)> func;
+				std::function<Response(const Request&, const Parameters&)> func;
 				std::function<bool(const http::Request&)> authFunc;
-				std::vector<std::string> params;
+				std::function<std::shared_ptr<BodyStream>(const Request&, const Parameters&)> streamFunc;
+				std::vector<std::string> params;	// sorted
+				uint64_t signature = 0;	// method and parameter names, key of Node::dispatch
+				bool isRegex = false;
+				std::regex regex;
+			};
+			// path segment of prefix tree, literal children are sorted and come before captures
+			struct Node
+			{
+				enum class Capture
+				{
+					None,
+					String,
+					Int
+				};
+				std::string segment;	// literal text or capture name
+				Capture capture = Capture::None;
+				std::vector<Node> children;
+				size_t literals = 0;	// number of literal children
+				std::unordered_multimap<uint64_t, size_t> dispatch;	// handle signature -> handle index
 			};
+			using Captures = std::vector<std::pair<std::string, std::string>>;
+			// index of matching handle, segment captures go to captures
+			size_t resolve(const Request& request, Parameters& captures, bool& endpointFound) const;
+			bool accepts(const Handle& handle, uint64_t signature, const Request& request) const;
+			size_t find(const Node& node, uint64_t signature, const Request& request) const;
+			size_t match(const Node& node, const std::vector<std::string>& segments, size_t index,
+				uint64_t signature, const Request& request, Captures& captures, bool& endpointFound) const;
+			Response dispatch(const Handle& handle, const Request& request, const Parameters& captures) const;
 			std::vector<Handle> _handles;
+			std::vector<size_t> _regexHandles;
+			Node _root;
 			std::function<Response(const Request&)> _defaultFunc;
 		};
 	}
 	namespace network
 	{	
+		// position in ParseState::arena, views are made when request is complete because arena may grow while parsing
+		struct ArenaSpan
+		{
+			size_t offset = 0;
+			size_t length = 0;
+		};
+
 		struct ParseState
 		{
-			http::Header currentHeader;
-			std::vector<http::Header> headers;
+			static const size_t keptArenaCapacity = 256 * 1024;
+			std::vector<char> arena;	// url, header and view mode body bytes of current request, capacity is kept between requests
+			ArenaSpan url;
+			std::vector<std::pair<ArenaSpan, ArenaSpan>> headers;
+			ArenaSpan body;	// Request mode appends body directly to Request::body
+			bool headerComplete = true;
+			size_t limit = 0;	// maximum arena size, headers and body
+			bool tooLarge = false;
+			bool streamAborted = false;
 			http::Method method;
-			http::Url url;
 			http::Version version;
-			const char* bodyStart = nullptr;
-			unsigned bodyLength = 0;
 			bool complete = false;
+			// parser callbacks of one token are consecutive so span stays contiguous, false when limit is exceeded
+			bool append(ArenaSpan& span, const char* at, size_t length);
+			std::string_view view(const ArenaSpan& span) const;
+			void reset();
 		};
 
 		class HttpSession : public Session
 		{
 		public:
 			static const int InfiniteKeepAlive = 0;
+			static const size_t defaultMaxReceiveBufferSize = 64 * 1024;
+			static const size_t defaultMaxRequestSize = 8 * 1024 * 1024;
 			HttpSession();
 			virtual ~HttpSession();
-			virtual void httpRequestAvailable(const http::Request& http) = 0;
+			enum class ParseMode
+			{
+				Request,	// httpRequestAvailable with owning http::Request
+				View		// httpRequestViewAvailable with views to receive arena
+			};
+			// default answers 501 Not Implemented, session overrides the one of its parse mode
+			virtual void httpRequestAvailable(const http::Request&);
+			virtual void httpRequestViewAvailable(const http::RequestView&);
+			// called in ParseMode::Request when headers are received, request has no body yet.
+			// Returned stream receives body in chunks as it arrives and request size limit does not apply to body
+			virtual std::shared_ptr<http::BodyStream> httpBodyStream(const http::Request&) { return nullptr; }
 		protected:
+			void setParseMode(ParseMode mode);
 			void setKeepaliveTimeout(unsigned seconds);
 			void setKeepaliveMaxRequests(unsigned maxRequests);
+			// compress text bodies of at least minimumSize bytes when client accepts gzip or deflate, 0 disables
+			void setCompression(size_t minimumSize);
+			// requests with larger headers and body are answered with 413 and connection is closed
+			void setMaxRequestSize(size_t bytes);
+			// receive buffer grows while reads fill it up to this size, also largest body buffer reserved ahead of data
+			void setMaxReceiveBufferSize(size_t bytes);
 			int send(http::Response& response);
 			int send(http::Response&& response);
+			// streaming response, status and headers are sent now and body follows in sendChunk calls until endChunked.
+			// Body uses Transfer-Encoding: chunked, http 1.0 clients get it as is and connection is closed after endChunked.
+			// Pipelined requests are held until endChunked and other responses can not be sent meanwhile
+			int beginChunked(http::Response& response);
+			// returns bytes waiting for socket or -1 on error, producer should wait for outputDrained() after outputFull()
+			int sendChunk(const char* data, size_t length);
+			int endChunked();
 			void update() override final;
 			void resetIdle();
 			int send(const char* data, unsigned dataLength) override;
+			int send(const peq::network::ConstBuffer* buffers, unsigned count) override;
 		private:
+			int sendRanges(http::Response& response, const std::vector<http::ByteRange>& ranges);
+			void connectionHeaders(http::Response& response);
+			void makeView();
+			void makeRequest();
+			// false when connection is closing
+			bool handleRequest();
+			void reject(http::Status status, const std::string& reason);
 			void dataAvailable() override;
+			void parse(const char* data, size_t length);
 			bool _keepAlive;
 			unsigned _keepAliveTimeout;
 			unsigned _timeout;
 			unsigned _keepAlivemMaxRequests;
 			unsigned _requests;
 			uint64_t _idleStarted;
+			size_t _compressionMinimumSize;
+			ParseMode _parseMode;
 
 			http::Request _currentRequest;
-			char _buffer[peq::network::receiveBufferSize];
+			http::RequestView _currentView;
+			std::shared_ptr<http::BodyStream> _bodyStream;
+			enum class Chunked
+			{
+				None,
+				Encoded,
+				Raw,	// http 1.0, body ends when connection closes
+				Head	// HEAD request, body is not sent
+			};
+			Chunked _chunked = Chunked::None;
+			std::vector<char> _pending;	// received while chunked response is sent, parsed after endChunked
+			bool _parsing = false;
+			std::vector<char> _buffer;	// grows while reads fill it, up to _maxReceiveBufferSize
+			size_t _maxReceiveBufferSize = defaultMaxReceiveBufferSize;
 			llhttp_t _parser;
 			llhttp_settings_t _settings;
 			ParseState _parseState;
@@ -10,6 +10,8 @@
 #include <future>
 #include <map>
 #include <optional>
+#include <atomic>
+#include <random>
 
 namespace peq {
 
@@ -21,11 +23,13 @@ namespace peq {
 		class ClientSocket;
 		class SessionFilter;
 		class SertificateContainer;
+		class File;
 		using SocketRef = std::shared_ptr<Socket>;
 		using ServerSocketRef = std::shared_ptr<ServerSocket>;
 		using ClientSocketRef = std::shared_ptr<ClientSocket>;
 		using SessionFilterRef = std::shared_ptr<SessionFilter>;
 		using SertificateContainerRef = std::shared_ptr<SertificateContainer>;
+		using FileRef = std::shared_ptr<File>;
 		
 		
 		struct Mac 
@@ -73,6 +77,48 @@ namespace peq {
 			std::function<int(char* buffer, size_t bytes)> recvFunc;
 		};
 
+		// non-owning view to bytes, used for scatter-gather writes
+		struct ConstBuffer
+		{
+			const char* data;
+			size_t size;
+		};
+
+		// bytes kept alive by owner, lets many responses send same cached data
+		struct SharedData
+		{
+			std::shared_ptr<const void> owner;
+			const char* data = nullptr;
+			size_t size = 0;
+		};
+
+		// read-only file that sockets can transmit without copying it to user space
+		class File
+		{
+		public:
+			static FileRef open(const std::string& path);
+			// maps whole file read-only to memory, data is empty when mapping fails
+			static SharedData map(const FileRef& file);
+			virtual ~File() = default;
+			File(const File&) = delete;
+			File& operator=(const File&) = delete;
+			virtual uint64_t size() const = 0;
+			// last modification time, seconds since epoch
+			virtual uint64_t modified() const = 0;
+			// reads from offset, returns bytes read or -1 on error
+			virtual int64_t read(char* data, size_t dataLength, uint64_t offset) const = 0;
+		protected:
+			File() = default;
+		};
+
+		// part of file, size is in bytes starting from offset
+		struct FileRange
+		{
+			FileRef file;
+			uint64_t offset = 0;
+			uint64_t size = 0;
+		};
+
 		class Socket {
 		public:
 			virtual unsigned id() const = 0;
@@ -87,12 +133,14 @@ namespace peq {
 		class ServerSocket : public Socket
 		{
 		public:
-			static ServerSocketRef create(int port, SocketMode mode);
+			static ServerSocketRef create(int port, SocketMode mode, bool reusePort = false);
 			virtual ~ServerSocket() = default;
 			ServerSocket(const ServerSocket&) = delete;
 			ServerSocket& operator=(const ServerSocket&) = delete;
 			ServerSocket& operator=(ServerSocket&&) = delete;
 			virtual ClientSocketRef accept() = 0;
+			// accepts up to max pending connections, returns number of accepted sockets
+			virtual unsigned accept(std::vector<ClientSocketRef>& sockets, unsigned max);
 		protected:
 			ServerSocket() = default;
 		};
@@ -112,7 +160,12 @@ namespace peq {
 			ClientSocket& operator=(const ClientSocket&) = delete;
 			ClientSocket& operator=(ClientSocket&&) = delete;
 			virtual int receive(char* data, unsigned dataLength) = 0;
+			// returns bytes written, non-blocking socket may write less than dataLength, -1 on error
 			virtual int send(const char* data, unsigned dataLength) = 0;
+			// writes buffers in order with single call when backend supports it, returns bytes written or -1
+			virtual int send(const ConstBuffer* buffers, unsigned count);
+			// writes part of file, returns bytes written or -1. Default implementation reads file in chunks
+			virtual int64_t sendFile(const File& file, uint64_t offset, uint64_t size);
 			virtual void disconnect() = 0;
 			virtual bool isDisconnected() const = 0;
 			virtual SocketInfo info() const = 0;
@@ -123,6 +176,12 @@ namespace peq {
 		class SocketSelector;
 		using SocketSelectorRef = std::shared_ptr<SocketSelector>;
 
+		enum class IOBackend
+		{
+			Default,	// epoll on Linux, poll on other BSD systems, select on Windows
+			IOUring		// io_uring completions on Linux, falls back to Default when kernel does not support it
+		};
+
 		class SocketSelector
 		{
 		public:
@@ -131,7 +190,15 @@ namespace peq {
 			virtual void add(SocketRef socket) = 0;
 			virtual void remove(SocketRef socket) = 0;
 			virtual void wakeUp() = 0;
+			// completion based selectors return socket that does its I/O through the selector,
+			// sockets are attached before they are added. Readiness based selectors return socket itself
+			virtual ClientSocketRef attach(ClientSocketRef socket) { return socket; }
+			virtual ServerSocketRef attach(ServerSocketRef socket) { return socket; }
+			// returns sockets ready for reading and sockets with write interest that are ready for writing
 			virtual std::vector<SocketRef> wait(unsigned timeoutms) = 0;
+			// report socket from wait() when it can be written, can be called from any thread.
+			// Backends with blocking sends never need write interest
+			virtual void setWriteInterest(SocketRef, bool) {}
 		};
 		
 		class Server;
@@ -145,11 +212,30 @@ namespace peq {
 			virtual void connected() = 0;
 			virtual void dataAvailable() = 0;
 			virtual void disconnected() = 0;
+			virtual ~Session() = default;
 		protected:
 			int receive(char* data, unsigned dataLength);
 			virtual int send(const char* data, unsigned dataLength);
+			virtual int send(const ConstBuffer* buffers, unsigned count);
+			// writes buffers followed by file range, plaintext sockets transmit file without copying it,
+			// secure sessions read and encrypt it chunk by chunk as socket drains
+			virtual int64_t sendFile(const ConstBuffer* buffers, unsigned count, const FileRange& file);
+			// writes buffers followed by shared data, unsent part is kept by reference instead of copying it
+			virtual int64_t sendShared(const ConstBuffer* buffers, unsigned count, const SharedData& data);
+			// disconnects after buffered output has been sent
 			void disconnect();
 			virtual void update() {};
+			// bytes waiting for socket to become writable
+			uint64_t pendingOutput() const;
+			void setOutputLimits(size_t highWaterMark, size_t lowWaterMark);
+			// called when pending output grows over high water mark, streaming sessions should stop producing data.
+			// Called after send has released its locks, so handler may send from it
+			virtual void outputFull() {};
+			// called when pending output has dropped under low water mark after outputFull()
+			virtual void outputDrained() {};
+			// while corked sends are queued, uncork writes them together with as few socket writes as possible
+			void cork();
+			void uncork();
 			SocketInfo info() const
 			{
 				return _socket->info();
@@ -159,18 +245,85 @@ namespace peq {
 				return _filter != nullptr;
 			}
 		private:
+			static constexpr uint64_t closeTimeoutMs = 30000;
+			static constexpr unsigned flushBuffers = 64;
+			static constexpr size_t fileChunkSize = 16 * 1024;
+			// queued output is copied bytes, shared data or file range
+			struct Output
+			{
+				Data data;
+				SharedData shared;
+				FileRange file;
+				// plaintext of secure session, flush() encrypts it when socket is writable
+				bool plain = false;
+				uint64_t size() const
+				{
+					return file.file ? file.size : view().size;
+				}
+				// bytes in memory, empty for file range
+				ConstBuffer view() const
+				{
+					return shared.data ? ConstBuffer{ shared.data, shared.size } : ConstBuffer{ data.data(), data.size() };
+				}
+			};
 			void doHandle();
+			void doUpdate();
+			void flush();
 			int socketReceive(char* data, unsigned dataLength);
 			int socketSend(const char* data, unsigned dataLength);
+			int socketSend(const ConstBuffer* buffers, unsigned count);
+			int64_t socketSend(const ConstBuffer* buffers, unsigned count, const Output& tail);
+			int64_t filterSend(const ConstBuffer* buffers, unsigned count, const Output& tail);
+			void notifyOutputFull();
+			int filterOutput(const char* data, unsigned dataLength);
+			void queuePlain(const ConstBuffer* buffers, unsigned count, const Output& tail);
+			// called with send and output mutexes held
+			bool encryptOutput();
+			// called with output mutex held
+			void setWriteInterest(bool enabled);
 			void bindFilter(SessionFilterRef filter);
 			friend class Server;
 			friend class ConnectionTask;
 			ClientSocketRef _socket;
 			SessionFilterRef _filter;
+			SocketSelectorRef _selector;
 			std::mutex m_sendMutex;
+			mutable std::mutex _outputMutex;
+			std::deque<Output> _output;
+			uint64_t _outputOffset = 0;
+			uint64_t _outputSize = 0;
+			size_t _highWaterMark = 1024 * 1024;
+			size_t _lowWaterMark = 256 * 1024;
+			bool _outputFull = false;
+			// output became full during send, outputFull() is due once send mutex is released
+			bool _outputFullPending = false;
+			bool _closing = false;
+			bool _corked = false;
+			bool _writeInterest = false;
+			uint64_t _closeDeadline = 0;
+			Data* _encrypted = nullptr;
 		};
 
 		using SessionRef = std::shared_ptr<Session>;
+
+		// how single acceptor assigns new connections to threads
+		enum class Distribution
+		{
+			RoundRobin,
+			LeastConnections,	// thread with fewest live connections, busy time breaks ties
+			PowerOfTwoChoices	// less loaded of two random threads
+		};
+
+		struct AcceptStats
+		{
+			uint64_t wakeups = 0;		// listen socket readiness events
+			uint64_t accepted = 0;		// accepted connections
+			unsigned largestBatch = 0;	// most connections accepted on single wakeup
+			double acceptedPerWakeup() const
+			{
+				return wakeups == 0 ? 0.0 : static_cast<double>(accepted) / static_cast<double>(wakeups);
+			}
+		};
 		
 		class Server
 		{
@@ -193,22 +346,31 @@ namespace peq {
 			class ConnectionTask : public peq::concurrency::ITask
 			{
 			public:
-				ConnectionTask();
+				ConnectionTask(Server* server);
 				void awake() override;
 				void execute() override;
 				void destroy() override;
-				void add(ClientSocketRef socket, SessionRef handler);
-				void abort();
-			private:
-				std::condition_variable _condition;
-				std::mutex _mutex;
 				struct NewSocket
 				{
 					ClientSocketRef socket;
 					SessionRef handler;
 				};
+				void add(ClientSocketRef socket, SessionRef handler);
+				void add(std::vector<NewSocket>& sockets);
+				void abort();
+				// live connections, including sockets not yet picked up by the task thread
+				unsigned connections() const;
+				// share of time spent handling sockets during last second, 0 - 1000
+				unsigned utilization() const;
+			private:
+				std::condition_variable _condition;
+				std::mutex _mutex;
 				std::vector<NewSocket> _newSockets;
 				SocketSelectorRef _selector;
+				ServerSocketRef _listenSocket;
+				Server* _server;
+				std::atomic<unsigned> _connections;
+				std::atomic<unsigned> _utilization;
 				bool _abort;
 			};
 		public:
@@ -224,23 +386,45 @@ namespace peq {
 			}
 			Server& setThreads(unsigned threads);
 			Server& setPort(unsigned port);
+			Server& setIOBackend(IOBackend backend);
+			// every thread accepts connections from its own SO_REUSEPORT listen socket
+			Server& setReusePort(bool enabled);
+			Server& setDistribution(Distribution distribution);
 			Server& setTLS(const std::string& crt, const std::string& key);
 			Server& setTLS(const std::string& pem);
+			AcceptStats acceptStats() const;
 		private:
+			static constexpr unsigned acceptBatchSize = 1024;
+			void accepted(unsigned count);
+			unsigned nextTask(const std::vector<unsigned>& pending);
+			void acceptLoop(ServerSocketRef listenSocket);
+			SessionRef createSession(ClientSocketRef socket);
 			std::unique_ptr<IProvideSessions> _sessionProvider;
 			peq::concurrency::Runner<ConnectionTask> _runner;
 			SertificateContainerRef _sertificates;
 			unsigned _threads;
 			std::atomic<bool> _stop;
 			unsigned _port;
+			IOBackend _ioBackend;
+			bool _reusePort;
+			Distribution _distribution;
+			unsigned _roundRobin;
+			std::minstd_rand _random;
+			std::vector<ServerSocketRef> _listenSockets;
+			std::atomic<uint64_t> _acceptWakeups;
+			std::atomic<uint64_t> _accepted;
+			std::atomic<unsigned> _largestAcceptBatch;
 			bool _tls;
 		};
 
 		void awake();
 		void destroy();
 
-		ServerSocketRef createServerSocket(int port, SocketMode mode);
+		ServerSocketRef createServerSocket(int port, SocketMode mode, bool reusePort);
 		SocketSelectorRef createSocketSelector();
+		SocketSelectorRef createSocketSelector(IOBackend backend);
+		FileRef createFile(const std::string& path);
+		SharedData mapFile(const FileRef& file);
 		//
 		SessionFilterRef createFilterTLS(SessionFilter::Mode mode, SertificateContainerRef sertificates);
 		SertificateContainerRef createSertificateContainer();
@@ -0,0 +1,79 @@
+#include "pequena/network/http/compression.h"
+#include "pequena/stringutils.h"
+#include <sstream>
+#include <algorithm>
+
+using namespace peq;
+using namespace peq::http;
+
+namespace
+{
+	std::string lower(std::string str)
+	{
+		std::transform(str.begin(), str.end(), str.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+		return str;
+	}
+
+	std::string trim(const std::string& str)
+	{
+		auto start = str.find_first_not_of(" \t");
+		if (start == std::string::npos) return std::string();
+		auto end = str.find_last_not_of(" \t");
+		return str.substr(start, end - start + 1);
+	}
+}
+
+Encoding peq::http::acceptedEncoding(const Request& request)
+{
+	// Accept-Encoding: gzip, deflate;q=0.5, *;q=0
+	float gzip = -1.0f;
+	float deflate = -1.0f;
+	float any = -1.0f;
+	if (auto h = request.headers.find(KnownHeader::AcceptEncoding))
+	{
+		std::istringstream st(h->value);
+		std::string item;
+		while (std::getline(st, item, ','))
+		{
+			float quality = 1.0f;
+			auto semicolon = item.find(';');
+			auto coding = lower(trim(item.substr(0, semicolon)));
+			if (semicolon != std::string::npos)
+			{
+				auto q = lower(trim(item.substr(semicolon + 1)));
+				if (q.size() > 2 && q[0] == 'q' && q[1] == '=')
+				{
+					quality = static_cast<float>(atof(q.c_str() + 2));
+				}
+			}
+			if (coding == "gzip" || coding == "x-gzip") gzip = quality;
+			else if (coding == "deflate") deflate = quality;
+			else if (coding == "*") any = quality;
+		}
+	}
+	if (gzip < 0.0f) gzip = any;
+	if (deflate < 0.0f) deflate = any;
+
+	if (gzip > 0.0f && gzip >= deflate) return Encoding::Gzip;
+	if (deflate > 0.0f) return Encoding::Deflate;
+	return Encoding::Identity;
+}
+
+std::string peq::http::toString(Encoding encoding)
+{
+	switch (encoding)
+	{
+	case Encoding::Gzip: return "gzip";
+	case Encoding::Deflate: return "deflate";
+	default: return "identity";
+	}
+}
+
+bool peq::http::compressible(const std::string& contentType)
+{
+	return contentType.compare(0, 5, "text/") == 0 ||
+		contentType.find("json") != std::string::npos ||
+		contentType.find("javascript") != std::string::npos ||
+		contentType.find("xml") != std::string::npos ||
+		contentType.find("svg") != std::string::npos;
+}
@@ -0,0 +1,15 @@
+#ifndef PEQ_ZLIB
+
+#include "pequena/network/http/compression.h"
+
+bool peq::http::compressionAvailable()
+{
+	return false;
+}
+
+peq::network::Data peq::http::compress(Encoding encoding, const char* data, size_t dataLength, int level)
+{
+	return peq::network::Data();
+}
+
+#endif
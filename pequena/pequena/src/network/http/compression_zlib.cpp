@@ -0,0 +1,48 @@
+#ifdef PEQ_ZLIB
+
+#include "pequena/network/http/compression.h"
+#include "pequena/log.h"
+#include <zlib.h>
+#include <cstring>
+
+bool peq::http::compressionAvailable()
+{
+	return true;
+}
+
+peq::network::Data peq::http::compress(Encoding encoding, const char* data, size_t dataLength, int level)
+{
+	if (encoding == Encoding::Identity)
+	{
+		return peq::network::Data();
+	}
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// window bits + 16 writes gzip wrapper, plain window bits zlib wrapper (http deflate)
+	int windowBits = encoding == Encoding::Gzip ? 15 + 16 : 15;
+	if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		peq::log::error("[ZLIB] deflateInit2 failed");
+		return peq::network::Data();
+	}
+
+	peq::network::Data out;
+	out.resize(deflateBound(&stream, static_cast<uLong>(dataLength)));
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream.avail_in = static_cast<uInt>(dataLength);
+	stream.next_out = reinterpret_cast<Bytef*>(out.data());
+	stream.avail_out = static_cast<uInt>(out.size());
+
+	auto result = deflate(&stream, Z_FINISH);
+	deflateEnd(&stream);
+	if (result != Z_STREAM_END)
+	{
+		peq::log::error("[ZLIB] deflate failed");
+		return peq::network::Data();
+	}
+	out.resize(stream.total_out);
+	return out;
+}
+
+#endif
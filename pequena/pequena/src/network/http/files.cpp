@@ -1,7 +1,9 @@
 #include "pequena/network/http/files.h"
+#include "pequena/network/http/compression.h"
 #include "pequena/log.h"
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
 
 using namespace peq::http;
 
@@ -24,6 +26,54 @@ namespace
 		return path.substr(root.size());
 #endif
 	}
+
+	// gzip representation has its own tag, validators always come from original file
+	std::string etag(const peq::network::File& file, bool gzip)
+	{
+		return fileETag(file, gzip ? "gz" : "");
+	}
+
+	bool conditional(const Request& request)
+	{
+		return request.headers.find(KnownHeader::IfNoneMatch) || request.headers.find(KnownHeader::IfModifiedSince);
+	}
+
+	std::string contentType(const std::string& path)
+	{
+		return Header::createContentTypeResponse(std::filesystem::u8path(path).extension().u8string()).value;
+	}
+
+	void appendHeader(std::string& headers, const Header& header)
+	{
+		headers += header.name;
+		headers += ": ";
+		headers += header.value;
+		headers += "\r\n";
+	}
+
+	std::string prepareHeaders(const std::string& path, uint64_t contentLength, const peq::network::File& original, bool gzip)
+	{
+		std::string headers;
+		auto type = contentType(path);
+		appendHeader(headers, Header("Content-Type", type));
+		appendHeader(headers, Header("Content-Length", peq::string::from(contentLength)));
+		if (gzip)
+		{
+			appendHeader(headers, Header("Content-Encoding", "gzip"));
+		}
+		if (gzip || compressible(type))
+		{
+			appendHeader(headers, Header("Vary", "Accept-Encoding"));
+		}
+		if (!gzip)
+		{
+			// ranges are served from identity representation
+			appendHeader(headers, Header("Accept-Ranges", "bytes"));
+		}
+		appendHeader(headers, Header("ETag", etag(original, gzip)));
+		appendHeader(headers, Header("Last-Modified", formatDate(original.modified())));
+		return headers;
+	}
 }
 
 Files::Files(const std::string& fileRoot) : _root(fileRoot)
@@ -37,6 +87,10 @@ Files::Files(const std::string& fileRoot) : _root(fileRoot)
 
 			auto str = p.u8string();
 			_paths[fsToUrl(str, _root)] = str;;
+			if (p.extension() == ".gz")
+			{
+				_gzipped.insert(str);
+			}
 		}
 	}
 	catch (const std::exception& e)
@@ -78,3 +132,261 @@ peq::network::Data Files::get(const std::string& path) const
 	fs.read(data.data(), l);
 	return data;
 }
+
+void Files::setCache(size_t budget, size_t maxFileSize)
+{
+	std::lock_guard<std::mutex> lock(_cacheMutex);
+	_cacheBudget = budget;
+	_cacheMaxFileSize = maxFileSize;
+	evict();
+}
+
+void Files::clearCache()
+{
+	std::lock_guard<std::mutex> lock(_cacheMutex);
+	_lru.clear();
+	_cache.clear();
+	_mapped.clear();
+	_incompressible.clear();
+	_cacheSize = 0;
+}
+
+void Files::setMode(Mode mode)
+{
+	std::lock_guard<std::mutex> lock(_cacheMutex);
+	_mode = mode;
+}
+
+Response Files::response(const Request& request) const
+{
+	auto path = getPath(request.url.path);
+	if (path.empty())
+	{
+		return Response(Status::NotFound);
+	}
+
+	bool gzip = acceptedEncoding(request) == Encoding::Gzip && !request.headers.find(KnownHeader::Range) &&
+		(_gzipped.count(path + ".gz") > 0 || (compressionAvailable() && compressible(contentType(path))));
+
+	if (conditional(request))
+	{
+		// validators come from file metadata, so body is not loaded when client copy is current
+		if (auto file = peq::network::File::open(path))
+		{
+			auto tag = etag(*file, gzip);
+			if (request.notModified(tag, file->modified()))
+			{
+				Response r(Status::NotModified);
+				r.headers.push_back(Header("ETag", tag));
+				r.headers.push_back(Header("Last-Modified", formatDate(file->modified())));
+				if (gzip || compressible(contentType(path)))
+				{
+					r.headers.push_back(Header("Vary", "Accept-Encoding"));
+				}
+				return r;
+			}
+		}
+	}
+
+	if (gzip)
+	{
+		if (auto file = cached(path, true))
+		{
+			return cachedResponse(file);
+		}
+	}
+	if (gzip && _gzipped.count(path + ".gz") > 0)
+	{
+		// sibling is sent from disk when it is not cached, headers are same as for cached sibling
+		auto sibling = peq::network::File::open(path + ".gz");
+		auto original = peq::network::File::open(path);
+		if (sibling && original)
+		{
+			auto headers = std::make_shared<std::string>(prepareHeaders(path, sibling->size(), *original, true));
+			Response r(Status::OK);
+			r.preparedHeaders = { headers, headers->data(), headers->size() };
+			r.file = { sibling, 0, sibling->size() };
+			return r;
+		}
+	}
+	if (auto file = cached(path, false))
+	{
+		return cachedResponse(file);
+	}
+
+	auto r = Response::createFromFile(Status::OK, path);
+	if (r.file.file && compressible(contentType(path)))
+	{
+		r.headers.push_back(Header("Vary", "Accept-Encoding"));
+	}
+	return r;
+}
+
+Response Files::cachedResponse(const CachedFileRef& file)
+{
+	// body and headers are shared with other responses, nothing is copied before send
+	Response r(Status::OK);
+	r.preparedHeaders = { file, file->headers.data(), file->headers.size() };
+	if (file->mapping.data)
+	{
+		r.sharedBody = { file, file->mapping.data, file->mapping.size };
+	}
+	else
+	{
+		r.sharedBody = { file, file->body.data(), file->body.size() };
+	}
+	return r;
+}
+
+Files::CachedFileRef Files::cached(const std::string& path, bool gzip) const
+{
+	// gzip variant is precompressed .gz sibling when there is one, otherwise compressed once and cached
+	auto key = gzip ? path + ".gz" : path;
+	bool sibling = gzip && _gzipped.count(key) > 0;
+	if (gzip && !sibling && !(compressionAvailable() && compressible(contentType(path))))
+	{
+		return nullptr;
+	}
+
+	size_t maxFileSize = 0;
+	bool map = false;
+	{
+		std::lock_guard<std::mutex> lock(_cacheMutex);
+		if (_mode == Mode::Mapped && (!gzip || sibling))
+		{
+			map = true;
+		}
+		else
+		{
+			if (_cacheBudget == 0 || _incompressible.count(key) > 0)
+			{
+				return nullptr;
+			}
+			auto it = _cache.find(key);
+			if (it != _cache.end())
+			{
+				_lru.splice(_lru.begin(), _lru, it->second);
+				return *it->second;
+			}
+			maxFileSize = std::min(_cacheMaxFileSize, _cacheBudget);
+		}
+	}
+	if (map)
+	{
+		return mapped(key, path, gzip);
+	}
+
+	// file is loaded without holding the lock, other threads keep serving cached files
+	bool compress = gzip && !sibling;
+	auto file = peq::network::File::open(compress ? path : key);
+	if (!file || file->size() > maxFileSize)
+	{
+		return nullptr;
+	}
+
+	auto entry = std::make_shared<CachedFile>();
+	entry->path = key;
+	entry->body.resize(static_cast<size_t>(file->size()));
+	size_t loaded = 0;
+	while (loaded < entry->body.size())
+	{
+		auto read = file->read(entry->body.data() + loaded, entry->body.size() - loaded, loaded);
+		if (read <= 0)
+		{
+			peq::log::error("failed to read file to cache: " + path);
+			return nullptr;
+		}
+		loaded += static_cast<size_t>(read);
+	}
+
+	if (compress)
+	{
+		// compressed once per file, so best compression is worth it
+		auto compressed = peq::http::compress(Encoding::Gzip, entry->body.data(), entry->body.size(), 9);
+		if (compressed.empty() || compressed.size() >= entry->body.size())
+		{
+			std::lock_guard<std::mutex> lock(_cacheMutex);
+			_incompressible.insert(key);
+			return nullptr;
+		}
+		entry->body = std::move(compressed);
+	}
+	auto original = sibling ? peq::network::File::open(path) : file;
+	if (!original)
+	{
+		return nullptr;
+	}
+	entry->headers = prepareHeaders(path, entry->body.size(), *original, gzip);
+
+	std::lock_guard<std::mutex> lock(_cacheMutex);
+	auto it = _cache.find(key);
+	if (it != _cache.end())
+	{
+		// another thread loaded same file
+		return *it->second;
+	}
+	_lru.push_front(entry);
+	_cache[key] = _lru.begin();
+	_cacheSize += entry->cost();
+	evict();
+	return entry;
+}
+
+Files::CachedFileRef Files::mapped(const std::string& key, const std::string& path, bool gzip) const
+{
+	// file is checked on every request, mapping is reused while size and modification time match
+	auto file = peq::network::File::open(key);
+	{
+		std::lock_guard<std::mutex> lock(_cacheMutex);
+		auto it = _mapped.find(key);
+		if (!file)
+		{
+			if (it != _mapped.end())
+			{
+				_mapped.erase(it);
+			}
+			return nullptr;
+		}
+		if (it != _mapped.end() && it->second->size == file->size() && it->second->modified == file->modified())
+		{
+			return it->second;
+		}
+	}
+
+	auto original = gzip ? peq::network::File::open(path) : file;
+	if (!original)
+	{
+		return nullptr;
+	}
+	auto entry = std::make_shared<CachedFile>();
+	entry->path = key;
+	entry->headers = prepareHeaders(path, file->size(), *original, gzip);
+	entry->size = file->size();
+	entry->modified = file->modified();
+	entry->mapping = peq::network::File::map(file);
+	if (!entry->mapping.data && file->size() > 0)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(_cacheMutex);
+	// first mapping wins when threads race on same file, responses still sending old mapping keep it alive
+	auto& current = _mapped[key];
+	if (!current || current->size != entry->size || current->modified != entry->modified)
+	{
+		current = entry;
+	}
+	return current;
+}
+
+void Files::evict() const
+{
+	// caller holds _cacheMutex, responses still using evicted files keep them alive
+	while (_cacheSize > _cacheBudget && !_lru.empty())
+	{
+		auto& last = _lru.back();
+		_cacheSize -= last->cost();
+		_cache.erase(last->path);
+		_lru.pop_back();
+	}
+}
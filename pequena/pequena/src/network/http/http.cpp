@@ -1,4 +1,5 @@
 #include "pequena/network/http/http.h"
+#include "pequena/network/http/compression.h"
 #include "pequena/time.h"
 #include "pequena/stringutils.h"
 #include "pequena/crypto/crypto.h"
@@ -8,6 +9,8 @@
 #include <filesystem>
 #include <regex>
 #include <ctime>
+#include <random>
+#include <atomic>
 
 
 using namespace peq;
@@ -24,15 +27,28 @@ namespace
 	const std::string s_contentTypeHeader = "Content-Type";
 	const std::string s_contentLengthHeader = "Content-Length";
 	const std::string s_apikeyHeader = "x-api-key";
-	const std::string s_cookie = "Cookie";
 	const std::string s_setCookieHeader = "Set-Cookie";
 	const std::string s_cacheControl = "Cache-Control";
+	const std::string s_contentEncodingHeader = "Content-Encoding";
+	const std::string s_varyHeader = "Vary";
+	const std::string s_etagHeader = "ETag";
+	const std::string s_lastModifiedHeader = "Last-Modified";
+	const std::string s_ifNoneMatchHeader = "If-None-Match";
+	const std::string s_ifModifiedSinceHeader = "If-Modified-Since";
+	const std::string s_rangeHeader = "Range";
+	const std::string s_ifRangeHeader = "If-Range";
+	const std::string s_acceptRangesHeader = "Accept-Ranges";
+	const std::string s_contentRangeHeader = "Content-Range";
+	const std::string s_acceptEncodingHeader = "Accept-Encoding";
+	const std::string s_transferEncodingHeader = "Transfer-Encoding";
+	// more ranges than this in one request is ignored and full content is sent
+	constexpr unsigned s_maxRanges = 32;
 	// Values
 	const std::string s_keepAliveValue = "Keep-Alive";
 	const std::string s_closeValue = "Close";
 	const std::string s_empty = "";
 
-	bool compare(const std::string& a, const std::string& b)
+	bool compare(std::string_view a, std::string_view b)
 	{
 		if (a.size() != b.size()) return false;
 
@@ -43,471 +59,693 @@ namespace
 			});
 	}
 
-	void httpDate(char* buf, size_t buf_len, struct tm* tm)
+	// names of KnownHeader values in same order
+	constexpr std::string_view s_knownHeaders[] = {
+		"Authorization",
+		"Connection",
+		"Cookie",
+		"x-api-key",
+		"If-None-Match",
+		"If-Modified-Since",
+		"Range",
+		"If-Range",
+		"Accept-Encoding",
+		"Content-Length",
+		"Content-Type",
+		"Host"
+	};
+	static_assert(sizeof(s_knownHeaders) / sizeof(s_knownHeaders[0]) == static_cast<size_t>(KnownHeader::Count), "s_knownHeaders does not match KnownHeader");
+
+	// "Sun, 06 Nov 1994 08:49:37 GMT"
+	constexpr size_t s_dateLength = 29;
+
+	// year, month and day of days since 1970-01-01, inverse of daysFromCivil
+	void civilFromDays(int64_t z, int64_t& y, unsigned& m, unsigned& d)
+	{
+		z += 719468;
+		const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+		const unsigned doe = static_cast<unsigned>(z - era * 146097);
+		const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		const unsigned mp = (5 * doy + 2) / 153;
+		d = doy - (153 * mp + 2) / 5 + 1;
+		m = mp < 10 ? mp + 3 : mp - 9;
+		y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+	}
+
+	// plain arithmetic instead of gmtime, which shares static result between threads
+	void httpDate(char* buf, size_t buf_len, uint64_t epoch)
 	{
 		const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 		const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
 
-		snprintf(buf, buf_len, "%s, %d %s %d %02d:%02d:%02d GMT",
-			days[tm->tm_wday], tm->tm_mday, months[tm->tm_mon],
-			tm->tm_year + 1900, tm->tm_hour, tm->tm_min, tm->tm_sec);
+		auto days1970 = static_cast<int64_t>(epoch / 86400);
+		auto seconds = static_cast<unsigned>(epoch % 86400);
+		int64_t year;
+		unsigned month, day;
+		civilFromDays(days1970, year, month, day);
+
+		// 1970-01-01 was Thursday
+		snprintf(buf, buf_len, "%s, %02u %s %lld %02u:%02u:%02u GMT",
+			days[(days1970 + 4) % 7], day, months[month - 1],
+			static_cast<long long>(year), seconds / 3600, seconds / 60 % 60, seconds % 60);
 	}
 
 	std::string httpDate(uint64_t epoch)
 	{
 		char buf[100] = { 0 };
-		time_t t = static_cast<time_t>(epoch);
-		struct tm* tm = gmtime(&t);
-		httpDate(buf, 100, tm);
+		httpDate(buf, sizeof(buf), epoch);
 		return std::string(buf);
 	}
 
+	// Date header value is rendered once per second and read by all connection threads.
+	// Sequence lock: writer keeps sequence odd while updating, reader retries when sequence changed during copy
+	class DateClock
+	{
+	public:
+		std::string now()
+		{
+			auto second = peq::time::epochS();
+			while (true)
+			{
+				auto begin = _sequence.load(std::memory_order_acquire);
+				if ((begin & 1) == 0)
+				{
+					auto cached = _second.load(std::memory_order_relaxed);
+					uint64_t words[s_words];
+					for (size_t i = 0; i < s_words; i++)
+					{
+						words[i] = _value[i].load(std::memory_order_relaxed);
+					}
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (_sequence.load(std::memory_order_relaxed) != begin)
+					{
+						continue;
+					}
+					if (cached == second)
+					{
+						return std::string(reinterpret_cast<const char*>(words), s_dateLength);
+					}
+					if (cached < second && _sequence.compare_exchange_strong(begin, begin + 1, std::memory_order_relaxed))
+					{
+						std::atomic_thread_fence(std::memory_order_release);
+						char rendered[s_words * sizeof(uint64_t)] = { 0 };
+						httpDate(rendered, sizeof(rendered), second);
+						memcpy(words, rendered, sizeof(words));
+						for (size_t i = 0; i < s_words; i++)
+						{
+							_value[i].store(words[i], std::memory_order_relaxed);
+						}
+						_second.store(second, std::memory_order_relaxed);
+						_sequence.store(begin + 2, std::memory_order_release);
+						return std::string(rendered, s_dateLength);
+					}
+				}
+				// other thread is rendering or this thread read clock before it, no waiting for it
+				return httpDate(second);
+			}
+		}
+	private:
+		static constexpr size_t s_words = (s_dateLength + sizeof(uint64_t)) / sizeof(uint64_t);
+		std::atomic<uint32_t> _sequence{ 0 };
+		std::atomic<uint64_t> _second{ 0 };
+		std::atomic<uint64_t> _value[s_words] = {};
+	};
+
+	DateClock s_dateClock;
+
 	std::string httpDateNow()
 	{
-		return httpDate(peq::time::epochS());
-	}
-
-	std::string toString(Status code)
-	{
-		int c = (int)code;
-		switch (c)
-		{
-		case 100: return "Continue";
-		case 101: return "Switching Protocols";
-		case 102: return "Processing";
-		case 103: return "Early Hints";
-		case 200: return "OK";
-		case 201: return "Created";
-		case 202: return "Accepted";
-		case 203: return "Non-Authoritative Information";
-		case 204: return "No Content";
-		case 205: return "Reset Content";
-		case 206: return "Partial Content";
-		case 207: return "Multi-Status";
-		case 208: return "Already Reported";
-		case 226: return "IM Used";
-		case 300: return "Multiple Choices";
-		case 301: return "Moved Permanently";
-		case 302: return "Found";
-		case 303: return "See Other";
-		case 304: return "Not Modified";
-		case 305: return "Use Proxy";
-		case 307: return "Temporary Redirect";
-		case 308: return "Permanent Redirect";
-		case 400: return "Bad Request";
-		case 401: return "Unauthorized";
-		case 402: return "Payment Required";
-		case 403: return "Forbidden";
-		case 404: return "Not Found";
-		case 405: return "Method Not Allowed";
-		case 406: return "Not Acceptable";
-		case 407: return "Proxy Authentication Required";
-		case 408: return "Request Timeout";
-		case 409: return "Conflict";
-		case 410: return "Gone";
-		case 411: return "Length Required";
-		case 412: return "Precondition Failed";
-		case 413: return "Content Too Large";
-		case 414: return "URI Too Long";
-		case 415: return "Unsupported Media Type";
-		case 416: return "Range Not Satisfiable";
-		case 417: return "Expectation Failed";
-		case 418: return "I'm a teapot";
-		case 421: return "Misdirected Request";
-		case 422: return "Unprocessable Content";
-		case 423: return "Locked";
-		case 424: return "Failed Dependency";
-		case 425: return "Too Early";
-		case 426: return "Upgrade Required";
-		case 428: return "Precondition Required";
-		case 429: return "Too Many Requests";
-		case 431: return "Request Header Fields Too Large";
-		case 451: return "Unavailable For Legal Reasons";
-		case 500: return "Internal Server Error";
-		case 501: return "Not Implemented";
-		case 502: return "Bad Gateway";
-		case 503: return "Service Unavailable";
-		case 504: return "Gateway Timeout";
-		case 505: return "HTTP Version Not Supported";
-		case 506: return "Variant Also Negotiates";
-		case 507: return "Insufficient Storage";
-		case 508: return "Loop Detected";
-		case 510: return "Not Extended";
-		case 511: return "Network Authentication Required";
-		default: return std::string();
+		return s_dateClock.now();
+	}
+
+	// days since 1970-01-01 for proleptic gregorian date
+	int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+	{
+		y -= m <= 2;
+		const int64_t era = (y >= 0 ? y : y - 399) / 400;
+		const unsigned yoe = static_cast<unsigned>(y - era * 400);
+		const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+		const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + static_cast<int64_t>(doe) - 719468;
+	}
+
+	bool parseNumber(const std::string& str, uint64_t& value)
+	{
+		if (str.empty() || str.size() > 19 || str.find_first_not_of("0123456789") != std::string::npos)
+		{
+			return false;
+		}
+		value = std::stoull(str);
+		return true;
+	}
+
+	std::string trim(const std::string& str)
+	{
+		auto start = str.find_first_not_of(" \t");
+		if (start == std::string::npos) return std::string();
+		auto end = str.find_last_not_of(" \t");
+		return str.substr(start, end - start + 1);
+	}
+
+	const char s_regexCharacters[] = ".[]()*+?^$|\\{}";
+	constexpr size_t s_noHandle = std::numeric_limits<size_t>::max();
+
+	// "/api/users/" -> "api", "users", ""
+	std::vector<std::string> splitPath(const std::string& path)
+	{
+		std::vector<std::string> segments;
+		size_t start = !path.empty() && path[0] == '/' ? 1 : 0;
+		while (true)
+		{
+			auto slash = path.find('/', start);
+			if (slash == std::string::npos)
+			{
+				segments.push_back(path.substr(start));
+				return segments;
+			}
+			segments.push_back(path.substr(start, slash - start));
+			start = slash + 1;
+		}
+	}
+
+	constexpr uint64_t s_fnvOffset = 14695981039346656037ull;
+	constexpr uint64_t s_fnvPrime = 1099511628211ull;
+
+	// FNV-1a of name followed by separator byte
+	uint64_t hashKey(uint64_t hash, const std::string& key)
+	{
+		for (auto c : key)
+		{
+			hash = (hash ^ static_cast<uint8_t>(c)) * s_fnvPrime;
+		}
+		return (hash ^ 0xff) * s_fnvPrime;
+	}
+
+	uint64_t hashKeys(const std::vector<std::string>& sortedKeys)
+	{
+		uint64_t hash = s_fnvOffset;
+		for (auto& key : sortedKeys)
+		{
+			hash = hashKey(hash, key);
+		}
+		return hash;
+	}
+
+	uint64_t routeSignature(peq::http::Method method, uint64_t keysHash)
+	{
+		return (keysHash ^ static_cast<uint64_t>(method)) * s_fnvPrime;
+	}
+
+	bool isInteger(const std::string& str)
+	{
+		size_t start = !str.empty() && str[0] == '-' ? 1 : 0;
+		return str.size() > start && str.find_first_not_of("0123456789", start) == std::string::npos;
+	}
+
+	bool isIdentifier(const std::string& str)
+	{
+		return !str.empty() && !isdigit(static_cast<unsigned char>(str[0])) &&
+			std::all_of(str.begin(), str.end(), [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+	}
+
+	// strips W/ prefix, weak comparison is used for GET
+	std::string opaqueTag(const std::string& tag)
+	{
+		if (tag.size() > 2 && tag[0] == 'W' && tag[1] == '/')
+		{
+			return tag.substr(2);
 		}
+		return tag;
 	}
+
+	struct StatusLine
+	{
+		Status status;
+		std::string_view line;
+	};
+
+	// sorted by status, pre-rendered for HTTP/1.1 responses
+	constexpr StatusLine s_statusLines[] = {
+		{ Status::Continue, "HTTP/1.1 100 Continue\r\n" },
+		{ Status::SwitchingProtocols, "HTTP/1.1 101 Switching Protocols\r\n" },
+		{ Status::Processing, "HTTP/1.1 102 Processing\r\n" },
+		{ Status::EarlyHints, "HTTP/1.1 103 Early Hints\r\n" },
+		{ Status::OK, "HTTP/1.1 200 OK\r\n" },
+		{ Status::Created, "HTTP/1.1 201 Created\r\n" },
+		{ Status::Accepted, "HTTP/1.1 202 Accepted\r\n" },
+		{ Status::NonAuthoritativeInformation, "HTTP/1.1 203 Non-Authoritative Information\r\n" },
+		{ Status::NoContent, "HTTP/1.1 204 No Content\r\n" },
+		{ Status::ResetContent, "HTTP/1.1 205 Reset Content\r\n" },
+		{ Status::PartialContent, "HTTP/1.1 206 Partial Content\r\n" },
+		{ Status::MultiStatus, "HTTP/1.1 207 Multi-Status\r\n" },
+		{ Status::AlreadyReported, "HTTP/1.1 208 Already Reported\r\n" },
+		{ Status::IMUsed, "HTTP/1.1 226 IM Used\r\n" },
+		{ Status::MultipleChoices, "HTTP/1.1 300 Multiple Choices\r\n" },
+		{ Status::MovedPermanently, "HTTP/1.1 301 Moved Permanently\r\n" },
+		{ Status::Found, "HTTP/1.1 302 Found\r\n" },
+		{ Status::SeeOther, "HTTP/1.1 303 See Other\r\n" },
+		{ Status::NotModified, "HTTP/1.1 304 Not Modified\r\n" },
+		{ Status::UseProxy, "HTTP/1.1 305 Use Proxy\r\n" },
+		{ Status::TemporaryRedirect, "HTTP/1.1 307 Temporary Redirect\r\n" },
+		{ Status::PermanentRedirect, "HTTP/1.1 308 Permanent Redirect\r\n" },
+		{ Status::BadRequest, "HTTP/1.1 400 Bad Request\r\n" },
+		{ Status::Unauthorized, "HTTP/1.1 401 Unauthorized\r\n" },
+		{ Status::PaymentRequired, "HTTP/1.1 402 Payment Required\r\n" },
+		{ Status::Forbidden, "HTTP/1.1 403 Forbidden\r\n" },
+		{ Status::NotFound, "HTTP/1.1 404 Not Found\r\n" },
+		{ Status::MethodNotAllowed, "HTTP/1.1 405 Method Not Allowed\r\n" },
+		{ Status::NotAcceptable, "HTTP/1.1 406 Not Acceptable\r\n" },
+		{ Status::ProxyAuthenticationRequired, "HTTP/1.1 407 Proxy Authentication Required\r\n" },
+		{ Status::RequestTimeout, "HTTP/1.1 408 Request Timeout\r\n" },
+		{ Status::Conflict, "HTTP/1.1 409 Conflict\r\n" },
+		{ Status::Gone, "HTTP/1.1 410 Gone\r\n" },
+		{ Status::LengthRequired, "HTTP/1.1 411 Length Required\r\n" },
+		{ Status::PreconditionFailed, "HTTP/1.1 412 Precondition Failed\r\n" },
+		{ Status::ContentTooLarge, "HTTP/1.1 413 Content Too Large\r\n" },
+		{ Status::URITooLong, "HTTP/1.1 414 URI Too Long\r\n" },
+		{ Status::UnsupportedMediaType, "HTTP/1.1 415 Unsupported Media Type\r\n" },
+		{ Status::RangeNotSatisfiable, "HTTP/1.1 416 Range Not Satisfiable\r\n" },
+		{ Status::ExpectationFailed, "HTTP/1.1 417 Expectation Failed\r\n" },
+		{ Status::ImATeapot, "HTTP/1.1 418 I'm a teapot\r\n" },
+		{ Status::MisdirectedRequest, "HTTP/1.1 421 Misdirected Request\r\n" },
+		{ Status::UnprocessableContent, "HTTP/1.1 422 Unprocessable Content\r\n" },
+		{ Status::Locked, "HTTP/1.1 423 Locked\r\n" },
+		{ Status::FailedDependency, "HTTP/1.1 424 Failed Dependency\r\n" },
+		{ Status::TooEarly, "HTTP/1.1 425 Too Early\r\n" },
+		{ Status::UpgradeRequired, "HTTP/1.1 426 Upgrade Required\r\n" },
+		{ Status::PreconditionRequired, "HTTP/1.1 428 Precondition Required\r\n" },
+		{ Status::TooManyRequests, "HTTP/1.1 429 Too Many Requests\r\n" },
+		{ Status::RequestHeaderFieldsTooLarge, "HTTP/1.1 431 Request Header Fields Too Large\r\n" },
+		{ Status::UnavailableForLegalReasons, "HTTP/1.1 451 Unavailable For Legal Reasons\r\n" },
+		{ Status::InternalServerError, "HTTP/1.1 500 Internal Server Error\r\n" },
+		{ Status::NotImplemented, "HTTP/1.1 501 Not Implemented\r\n" },
+		{ Status::BadGateway, "HTTP/1.1 502 Bad Gateway\r\n" },
+		{ Status::ServiceUnavailable, "HTTP/1.1 503 Service Unavailable\r\n" },
+		{ Status::GatewayTimeout, "HTTP/1.1 504 Gateway Timeout\r\n" },
+		{ Status::HTTPVersionNotSupported, "HTTP/1.1 505 HTTP Version Not Supported\r\n" },
+		{ Status::VariantAlsoNegotiates, "HTTP/1.1 506 Variant Also Negotiates\r\n" },
+		{ Status::InsufficientStorage, "HTTP/1.1 507 Insufficient Storage\r\n" },
+		{ Status::LoopDetected, "HTTP/1.1 508 Loop Detected\r\n" },
+		{ Status::NotExtended, "HTTP/1.1 510 Not Extended\r\n" },
+		{ Status::NetworkAuthenticationRequired, "HTTP/1.1 511 Network Authentication Required\r\n" }
+	};
+	// "HTTP/1.1 200 " before reason phrase
+	constexpr size_t s_statusPrefix = 13;
+
+	std::string_view statusLine(Status status)
+	{
+		auto it = std::lower_bound(std::begin(s_statusLines), std::end(s_statusLines), status, [](const StatusLine& l, Status s) {
+			return l.status < s;
+		});
+		return it != std::end(s_statusLines) && it->status == status ? it->line : std::string_view();
+	}
+
 	struct MimeType
 	{
-		std::string extension;
-		std::string type;
+		std::string_view extension;
+		std::string_view type;
 	};
 
-	MimeType s_mimeTypes[348] = {
-		{"*3gpp", "audio/3gpp"},
-		{"*jpm", "video/jpm"},
-		{"*mp3", "audio/mp3"},
-		{"*rtf", "text/rtf"},
-		{"*wav", "audio/wave"},
-		{"*xml", "text/xml"},
-		{"3g2", "video/3gpp2"},
-		{"3gp", "video/3gpp"},
-		{"3gpp", "video/3gpp"},
-		{"ac", "application/pkix-attr-cert"},
-		{"adp", "audio/adpcm"},
-		{"ai", "application/postscript"},
-		{"apng", "image/apng"},
-		{"appcache", "text/cache-manifest"},
-		{"asc", "application/pgp-signature"},
-		{"atom", "application/atom+xml"},
-		{"atomcat", "application/atomcat+xml"},
-		{"atomsvc", "application/atomsvc+xml"},
-		{"au", "audio/basic"},
-		{"aw", "application/applixware"},
-		{"bdoc", "application/bdoc"},
-		{"bin", "application/octet-stream"},
-		{"bmp", "image/bmp"},
-		{"bpk", "application/octet-stream"},
-		{"buffer", "application/octet-stream"},
-		{"ccxml", "application/ccxml+xml"},
-		{"cdmia", "application/cdmi-capability"},
-		{"cdmic", "application/cdmi-container"},
-		{"cdmid", "application/cdmi-domain"},
-		{"cdmio", "application/cdmi-object"},
-		{"cdmiq", "application/cdmi-queue"},
-		{"cer", "application/pkix-cert"},
-		{"cgm", "image/cgm"},
-		{"class", "application/java-vm"},
-		{"coffee", "text/coffeescript"},
-		{"conf", "text/plain"},
-		{"cpt", "application/mac-compactpro"},
-		{"crl", "application/pkix-crl"},
-		{"css", "text/css"},
-		{"csv", "text/csv"},
-		{"cu", "application/cu-seeme"},
-		{"davmount", "application/davmount+xml"},
-		{"dbk", "application/docbook+xml"},
-		{"deb", "application/octet-stream"},
-		{"def", "text/plain"},
-		{"event-stream", "text/event-stream"},
-		{"deploy", "application/octet-stream"},
-		{"disposition-notification", "message/disposition-notification"},
-		{"dist", "application/octet-stream"},
-		{"distz", "application/octet-stream"},
-		{"dll", "application/octet-stream"},
-		{"dmg", "application/octet-stream"},
-		{"dms", "application/octet-stream"},
-		{"doc", "application/msword"},
-		{"dot", "application/msword"},
-		{"drle", "image/dicom-rle"},
-		{"dssc", "application/dssc+der"},
-		{"dtd", "application/xml-dtd"},
-		{"dump", "application/octet-stream"},
-		{"ear", "application/java-archive"},
-		{"ecma", "application/ecmascript"},
-		{"elc", "application/octet-stream"},
-		{"emf", "image/emf"},
-		{"eml", "message/rfc822"},
-		{"emma", "application/emma+xml"},
-		{"eps", "application/postscript"},
-		{"epub", "application/epub+zip"},
-		{"es", "application/ecmascript"},
-		{"exe", "application/octet-stream"},
-		{"exi", "application/exi"},
-		{"exr", "image/aces"},
-		{"ez", "application/andrew-inset"},
-		{"fits", "image/fits"},
-		{"g3", "image/g3fax"},
-		{"gbr", "application/rpki-ghostbusters"},
-		{"geojson", "application/geo+json"},
-		{"gif", "image/gif"},
-		{"glb", "model/gltf-binary"},
-		{"gltf", "model/gltf+json"},
-		{"gml", "application/gml+xml"},
-		{"gpx", "application/gpx+xml"},
-		{"gram", "application/srgs"},
-		{"grxml", "application/srgs+xml"},
-		{"gxf", "application/gxf"},
-		{"gz", "application/gzip"},
-		{"h261", "video/h261"},
-		{"h263", "video/h263"},
-		{"h264", "video/h264"},
-		{"heic", "image/heic"},
-		{"heics", "image/heic-sequence"},
-		{"heif", "image/heif"},
-		{"heifs", "image/heif-sequence"},
-		{"hjson", "application/hjson"},
-		{"hlp", "application/winhlp"},
-		{"hqx", "application/mac-binhex40"},
-		{"htm", "text/html"},
-		{"html", "text/html"},
-		{"ics", "text/calendar"},
-		{"ief", "image/ief"},
-		{"ifb", "text/calendar"},
-		{"iges", "model/iges"},
-		{"igs", "model/iges"},
-		{"img", "application/octet-stream"},
-		{"in", "text/plain"},
-		{"ini", "text/plain"},
-		{"ink", "application/inkml+xml"},
-		{"inkml", "application/inkml+xml"},
-		{"ipfix", "application/ipfix"},
-		{"iso", "application/octet-stream"},
-		{"jade", "text/jade"},
-		{"jar", "application/java-archive"},
-		{"jls", "image/jls"},
-		{"jp2", "image/jp2"},
-		{"jpe", "image/jpeg"},
-		{"jpeg", "image/jpeg"},
-		{"jpf", "image/jpx"},
-		{"jpg", "image/jpeg"},
-		{"jpg2", "image/jp2"},
-		{"jpgm", "video/jpm"},
-		{"jpgv", "video/jpeg"},
-		{"jpm", "image/jpm"},
-		{"jpx", "image/jpx"},
-		{"js", "application/javascript"},
-		{"json", "application/json"},
-		{"json5", "application/json5"},
-		{"jsonld", "application/ld+json"},
-		{"jsonml", "application/jsonml+json"},
-		{"jsx", "text/jsx"},
-		{"kar", "audio/midi"},
-		{"ktx", "image/ktx"},
-		{"less", "text/less"},
-		{"list", "text/plain"},
-		{"litcoffee", "text/coffeescript"},
-		{"log", "text/plain"},
-		{"lostxml", "application/lost+xml"},
-		{"lrf", "application/octet-stream"},
-		{"m1v", "video/mpeg"},
-		{"m21", "application/mp21"},
-		{"m2a", "audio/mpeg"},
-		{"m2v", "video/mpeg"},
-		{"m3a", "audio/mpeg"},
-		{"m4a", "audio/mp4"},
-		{"m4p", "application/mp4"},
-		{"ma", "application/mathematica"},
-		{"mads", "application/mads+xml"},
-		{"man", "text/troff"},
-		{"manifest", "text/cache-manifest"},
-		{"map", "application/json"},
-		{"mar", "application/octet-stream"},
-		{"markdown", "text/markdown"},
-		{"mathml", "application/mathml+xml"},
-		{"mb", "application/mathematica"},
-		{"mbox", "application/mbox"},
-		{"md", "text/markdown"},
-		{"me", "text/troff"},
-		{"mesh", "model/mesh"},
-		{"meta4", "application/metalink4+xml"},
-		{"metalink", "application/metalink+xml"},
-		{"mets", "application/mets+xml"},
-		{"mft", "application/rpki-manifest"},
-		{"mid", "audio/midi"},
-		{"midi", "audio/midi"},
-		{"mime", "message/rfc822"},
-		{"mj2", "video/mj2"},
-		{"mjp2", "video/mj2"},
-		{"mjs", "application/javascript"},
-		{"mml", "text/mathml"},
-		{"mods", "application/mods+xml"},
-		{"mov", "video/quicktime"},
-		{"mp2", "audio/mpeg"},
-		{"mp21", "application/mp21"},
-		{"mp2a", "audio/mpeg"},
-		{"mp3", "audio/mpeg"},
-		{"mp4", "video/mp4"},
-		{"mp4a", "audio/mp4"},
-		{"mp4s", "application/mp4"},
-		{"mp4v", "video/mp4"},
-		{"mpd", "application/dash+xml"},
-		{"mpe", "video/mpeg"},
-		{"mpeg", "video/mpeg"},
-		{"mpg", "video/mpeg"},
-		{"mpg4", "video/mp4"},
-		{"mpga", "audio/mpeg"},
-		{"mrc", "application/marc"},
-		{"mrcx", "application/marcxml+xml"},
-		{"ms", "text/troff"},
-		{"mscml", "application/mediaservercontrol+xml"},
-		{"msh", "model/mesh"},
-		{"msi", "application/octet-stream"},
-		{"msm", "application/octet-stream"},
-		{"msp", "application/octet-stream"},
-		{"mxf", "application/mxf"},
-		{"mxml", "application/xv+xml"},
-		{"n3", "text/n3"},
-		{"nb", "application/mathematica"},
-		{"oda", "application/oda"},
-		{"oga", "audio/ogg"},
-		{"ogg", "audio/ogg"},
-		{"ogv", "video/ogg"},
-		{"ogx", "application/ogg"},
-		{"omdoc", "application/omdoc+xml"},
-		{"onepkg", "application/onenote"},
-		{"onetmp", "application/onenote"},
-		{"onetoc", "application/onenote"},
-		{"onetoc2", "application/onenote"},
-		{"opf", "application/oebps-package+xml"},
-		{"otf", "font/otf"},
-		{"owl", "application/rdf+xml"},
-		{"oxps", "application/oxps"},
-		{"p10", "application/pkcs10"},
-		{"p7c", "application/pkcs7-mime"},
-		{"p7m", "application/pkcs7-mime"},
-		{"p7s", "application/pkcs7-signature"},
-		{"p8", "application/pkcs8"},
-		{"pdf", "application/pdf"},
-		{"pfr", "application/font-tdpfr"},
-		{"pgp", "application/pgp-encrypted"},
-		{"pkg", "application/octet-stream"},
-		{"pki", "application/pkixcmp"},
-		{"pkipath", "application/pkix-pkipath"},
-		{"pls", "application/pls+xml"},
-		{"png", "image/png"},
-		{"prf", "application/pics-rules"},
-		{"ps", "application/postscript"},
-		{"pskcxml", "application/pskc+xml"},
-		{"qt", "video/quicktime"},
-		{"raml", "application/raml+yaml"},
-		{"rdf", "application/rdf+xml"},
-		{"rif", "application/reginfo+xml"},
-		{"rl", "application/resource-lists+xml"},
-		{"rld", "application/resource-lists-diff+xml"},
-		{"rmi", "audio/midi"},
-		{"rnc", "application/relax-ng-compact-syntax"},
-		{"rng", "application/xml"},
-		{"roa", "application/rpki-roa"},
-		{"roff", "text/troff"},
-		{"rq", "application/sparql-query"},
-		{"rs", "application/rls-services+xml"},
-		{"rsd", "application/rsd+xml"},
-		{"rss", "application/rss+xml"},
-		{"rtf", "application/rtf"},
-		{"rtx", "text/richtext"},
-		{"s3m", "audio/s3m"},
-		{"sbml", "application/sbml+xml"},
-		{"scq", "application/scvp-cv-request"},
-		{"scs", "application/scvp-cv-response"},
-		{"sdp", "application/sdp"},
-		{"ser", "application/java-serialized-object"},
-		{"setpay", "application/set-payment-initiation"},
-		{"setreg", "application/set-registration-initiation"},
-		{"sgi", "image/sgi"},
-		{"sgm", "text/sgml"},
-		{"sgml", "text/sgml"},
-		{"shex", "text/shex"},
-		{"shf", "application/shf+xml"},
-		{"shtml", "text/html"},
-		{"sig", "application/pgp-signature"},
-		{"sil", "audio/silk"},
-		{"silo", "model/mesh"},
-		{"slim", "text/slim"},
-		{"slm", "text/slim"},
-		{"smi", "application/smil+xml"},
-		{"smil", "application/smil+xml"},
-		{"snd", "audio/basic"},
-		{"so", "application/octet-stream"},
-		{"spp", "application/scvp-vp-response"},
-		{"spq", "application/scvp-vp-request"},
-		{"spx", "audio/ogg"},
-		{"sru", "application/sru+xml"},
-		{"srx", "application/sparql-results+xml"},
-		{"ssdl", "application/ssdl+xml"},
-		{"ssml", "application/ssml+xml"},
-		{"stk", "application/hyperstudio"},
-		{"styl", "text/stylus"},
-		{"stylus", "text/stylus"},
-		{"svg", "image/svg+xml"},
-		{"svgz", "image/svg+xml"},
-		{"t", "text/troff"},
-		{"t38", "image/t38"},
-		{"tei", "application/tei+xml"},
-		{"teicorpus", "application/tei+xml"},
-		{"text", "text/plain"},
-		{"tfi", "application/thraud+xml"},
-		{"tfx", "image/tiff-fx"},
-		{"tif", "image/tiff"},
-		{"tiff", "image/tiff"},
-		{"tr", "text/troff"},
-		{"ts", "video/mp2t"},
-		{"tsd", "application/timestamped-data"},
-		{"tsv", "text/tab-separated-values"},
-		{"ttc", "font/collection"},
-		{"ttf", "font/ttf"},
-		{"ttl", "text/turtle"},
-		{"txt", "text/plain"},
-		{"u8dsn", "message/global-delivery-status"},
-		{"u8hdr", "message/global-headers"},
-		{"u8mdn", "message/global-disposition-notification"},
-		{"u8msg", "message/global"},
-		{"uri", "text/uri-list"},
-		{"uris", "text/uri-list"},
-		{"urls", "text/uri-list"},
-		{"vcard", "text/vcard"},
-		{"vrml", "model/vrml"},
-		{"vtt", "text/vtt"},
-		{"vxml", "application/voicexml+xml"},
-		{"war", "application/java-archive"},
-		{"wasm", "application/wasm"},
-		{"wav", "audio/wav"},
-		{"weba", "audio/webm"},
-		{"webm", "video/webm"},
-		{"webmanifest", "application/manifest+json"},
-		{"webp", "image/webp"},
-		{"wgt", "application/widget"},
-		{"wmf", "image/wmf"},
-		{"woff", "font/woff"},
-		{"woff2", "font/woff2"},
-		{"wrl", "model/vrml"},
-		{"wsdl", "application/wsdl+xml"},
-		{"wspolicy", "application/wspolicy+xml"},
-		{"x3d", "model/x3d+xml"},
-		{"x3db", "model/x3d+binary"},
-		{"x3dbz", "model/x3d+binary"},
-		{"x3dv", "model/x3d+vrml"},
-		{"x3dvz", "model/x3d+vrml"},
-		{"x3dz", "model/x3d+xml"},
-		{"xaml", "application/xaml+xml"},
-		{"xdf", "application/xcap-diff+xml"},
-		{"xdssc", "application/dssc+xml"},
-		{"xenc", "application/xenc+xml"},
-		{"xer", "application/patch-ops-error+xml"},
-		{"xht", "application/xhtml+xml"},
-		{"xhtml", "application/xhtml+xml"},
-		{"xhvml", "application/xv+xml"},
-		{"xm", "audio/xm"},
-		{"xml", "application/xml"},
-		{"xop", "application/xop+xml"},
-		{"xpl", "application/xproc+xml"},
-		{"xsd", "application/xml"},
-		{"xsl", "application/xml"},
-		{"xslt", "application/xslt+xml"},
-		{"xspf", "application/xspf+xml"},
-		{"xvm", "application/xv+xml"},
-		{"xvml", "application/xv+xml"},
-		{"yaml", "text/yaml"},
-		{"yang", "application/yang"},
-		{"yin", "application/yin+xml"},
-		{"yml", "text/yaml"},
-		{"zip", "application/zip"},
+	// sorted by extension for binary search
+	constexpr MimeType s_mimeTypes[] = {
+		{ "*3gpp", "audio/3gpp" },
+		{ "*jpm", "video/jpm" },
+		{ "*mp3", "audio/mp3" },
+		{ "*rtf", "text/rtf" },
+		{ "*wav", "audio/wave" },
+		{ "*xml", "text/xml" },
+		{ "3g2", "video/3gpp2" },
+		{ "3gp", "video/3gpp" },
+		{ "3gpp", "video/3gpp" },
+		{ "ac", "application/pkix-attr-cert" },
+		{ "adp", "audio/adpcm" },
+		{ "ai", "application/postscript" },
+		{ "apng", "image/apng" },
+		{ "appcache", "text/cache-manifest" },
+		{ "asc", "application/pgp-signature" },
+		{ "atom", "application/atom+xml" },
+		{ "atomcat", "application/atomcat+xml" },
+		{ "atomsvc", "application/atomsvc+xml" },
+		{ "au", "audio/basic" },
+		{ "aw", "application/applixware" },
+		{ "bdoc", "application/bdoc" },
+		{ "bin", "application/octet-stream" },
+		{ "bmp", "image/bmp" },
+		{ "bpk", "application/octet-stream" },
+		{ "buffer", "application/octet-stream" },
+		{ "ccxml", "application/ccxml+xml" },
+		{ "cdmia", "application/cdmi-capability" },
+		{ "cdmic", "application/cdmi-container" },
+		{ "cdmid", "application/cdmi-domain" },
+		{ "cdmio", "application/cdmi-object" },
+		{ "cdmiq", "application/cdmi-queue" },
+		{ "cer", "application/pkix-cert" },
+		{ "cgm", "image/cgm" },
+		{ "class", "application/java-vm" },
+		{ "coffee", "text/coffeescript" },
+		{ "conf", "text/plain" },
+		{ "cpt", "application/mac-compactpro" },
+		{ "crl", "application/pkix-crl" },
+		{ "css", "text/css" },
+		{ "csv", "text/csv" },
+		{ "cu", "application/cu-seeme" },
+		{ "davmount", "application/davmount+xml" },
+		{ "dbk", "application/docbook+xml" },
+		{ "deb", "application/octet-stream" },
+		{ "def", "text/plain" },
+		{ "deploy", "application/octet-stream" },
+		{ "disposition-notification", "message/disposition-notification" },
+		{ "dist", "application/octet-stream" },
+		{ "distz", "application/octet-stream" },
+		{ "dll", "application/octet-stream" },
+		{ "dmg", "application/octet-stream" },
+		{ "dms", "application/octet-stream" },
+		{ "doc", "application/msword" },
+		{ "dot", "application/msword" },
+		{ "drle", "image/dicom-rle" },
+		{ "dssc", "application/dssc+der" },
+		{ "dtd", "application/xml-dtd" },
+		{ "dump", "application/octet-stream" },
+		{ "ear", "application/java-archive" },
+		{ "ecma", "application/ecmascript" },
+		{ "elc", "application/octet-stream" },
+		{ "emf", "image/emf" },
+		{ "eml", "message/rfc822" },
+		{ "emma", "application/emma+xml" },
+		{ "eps", "application/postscript" },
+		{ "epub", "application/epub+zip" },
+		{ "es", "application/ecmascript" },
+		{ "event-stream", "text/event-stream" },
+		{ "exe", "application/octet-stream" },
+		{ "exi", "application/exi" },
+		{ "exr", "image/aces" },
+		{ "ez", "application/andrew-inset" },
+		{ "fits", "image/fits" },
+		{ "g3", "image/g3fax" },
+		{ "gbr", "application/rpki-ghostbusters" },
+		{ "geojson", "application/geo+json" },
+		{ "gif", "image/gif" },
+		{ "glb", "model/gltf-binary" },
+		{ "gltf", "model/gltf+json" },
+		{ "gml", "application/gml+xml" },
+		{ "gpx", "application/gpx+xml" },
+		{ "gram", "application/srgs" },
+		{ "grxml", "application/srgs+xml" },
+		{ "gxf", "application/gxf" },
+		{ "gz", "application/gzip" },
+		{ "h261", "video/h261" },
+		{ "h263", "video/h263" },
+		{ "h264", "video/h264" },
+		{ "heic", "image/heic" },
+		{ "heics", "image/heic-sequence" },
+		{ "heif", "image/heif" },
+		{ "heifs", "image/heif-sequence" },
+		{ "hjson", "application/hjson" },
+		{ "hlp", "application/winhlp" },
+		{ "hqx", "application/mac-binhex40" },
+		{ "htm", "text/html" },
+		{ "html", "text/html" },
+		{ "ics", "text/calendar" },
+		{ "ief", "image/ief" },
+		{ "ifb", "text/calendar" },
+		{ "iges", "model/iges" },
+		{ "igs", "model/iges" },
+		{ "img", "application/octet-stream" },
+		{ "in", "text/plain" },
+		{ "ini", "text/plain" },
+		{ "ink", "application/inkml+xml" },
+		{ "inkml", "application/inkml+xml" },
+		{ "ipfix", "application/ipfix" },
+		{ "iso", "application/octet-stream" },
+		{ "jade", "text/jade" },
+		{ "jar", "application/java-archive" },
+		{ "jls", "image/jls" },
+		{ "jp2", "image/jp2" },
+		{ "jpe", "image/jpeg" },
+		{ "jpeg", "image/jpeg" },
+		{ "jpf", "image/jpx" },
+		{ "jpg", "image/jpeg" },
+		{ "jpg2", "image/jp2" },
+		{ "jpgm", "video/jpm" },
+		{ "jpgv", "video/jpeg" },
+		{ "jpm", "image/jpm" },
+		{ "jpx", "image/jpx" },
+		{ "js", "application/javascript" },
+		{ "json", "application/json" },
+		{ "json5", "application/json5" },
+		{ "jsonld", "application/ld+json" },
+		{ "jsonml", "application/jsonml+json" },
+		{ "jsx", "text/jsx" },
+		{ "kar", "audio/midi" },
+		{ "ktx", "image/ktx" },
+		{ "less", "text/less" },
+		{ "list", "text/plain" },
+		{ "litcoffee", "text/coffeescript" },
+		{ "log", "text/plain" },
+		{ "lostxml", "application/lost+xml" },
+		{ "lrf", "application/octet-stream" },
+		{ "m1v", "video/mpeg" },
+		{ "m21", "application/mp21" },
+		{ "m2a", "audio/mpeg" },
+		{ "m2v", "video/mpeg" },
+		{ "m3a", "audio/mpeg" },
+		{ "m4a", "audio/mp4" },
+		{ "m4p", "application/mp4" },
+		{ "ma", "application/mathematica" },
+		{ "mads", "application/mads+xml" },
+		{ "man", "text/troff" },
+		{ "manifest", "text/cache-manifest" },
+		{ "map", "application/json" },
+		{ "mar", "application/octet-stream" },
+		{ "markdown", "text/markdown" },
+		{ "mathml", "application/mathml+xml" },
+		{ "mb", "application/mathematica" },
+		{ "mbox", "application/mbox" },
+		{ "md", "text/markdown" },
+		{ "me", "text/troff" },
+		{ "mesh", "model/mesh" },
+		{ "meta4", "application/metalink4+xml" },
+		{ "metalink", "application/metalink+xml" },
+		{ "mets", "application/mets+xml" },
+		{ "mft", "application/rpki-manifest" },
+		{ "mid", "audio/midi" },
+		{ "midi", "audio/midi" },
+		{ "mime", "message/rfc822" },
+		{ "mj2", "video/mj2" },
+		{ "mjp2", "video/mj2" },
+		{ "mjs", "application/javascript" },
+		{ "mml", "text/mathml" },
+		{ "mods", "application/mods+xml" },
+		{ "mov", "video/quicktime" },
+		{ "mp2", "audio/mpeg" },
+		{ "mp21", "application/mp21" },
+		{ "mp2a", "audio/mpeg" },
+		{ "mp3", "audio/mpeg" },
+		{ "mp4", "video/mp4" },
+		{ "mp4a", "audio/mp4" },
+		{ "mp4s", "application/mp4" },
+		{ "mp4v", "video/mp4" },
+		{ "mpd", "application/dash+xml" },
+		{ "mpe", "video/mpeg" },
+		{ "mpeg", "video/mpeg" },
+		{ "mpg", "video/mpeg" },
+		{ "mpg4", "video/mp4" },
+		{ "mpga", "audio/mpeg" },
+		{ "mrc", "application/marc" },
+		{ "mrcx", "application/marcxml+xml" },
+		{ "ms", "text/troff" },
+		{ "mscml", "application/mediaservercontrol+xml" },
+		{ "msh", "model/mesh" },
+		{ "msi", "application/octet-stream" },
+		{ "msm", "application/octet-stream" },
+		{ "msp", "application/octet-stream" },
+		{ "mxf", "application/mxf" },
+		{ "mxml", "application/xv+xml" },
+		{ "n3", "text/n3" },
+		{ "nb", "application/mathematica" },
+		{ "oda", "application/oda" },
+		{ "oga", "audio/ogg" },
+		{ "ogg", "audio/ogg" },
+		{ "ogv", "video/ogg" },
+		{ "ogx", "application/ogg" },
+		{ "omdoc", "application/omdoc+xml" },
+		{ "onepkg", "application/onenote" },
+		{ "onetmp", "application/onenote" },
+		{ "onetoc", "application/onenote" },
+		{ "onetoc2", "application/onenote" },
+		{ "opf", "application/oebps-package+xml" },
+		{ "otf", "font/otf" },
+		{ "owl", "application/rdf+xml" },
+		{ "oxps", "application/oxps" },
+		{ "p10", "application/pkcs10" },
+		{ "p7c", "application/pkcs7-mime" },
+		{ "p7m", "application/pkcs7-mime" },
+		{ "p7s", "application/pkcs7-signature" },
+		{ "p8", "application/pkcs8" },
+		{ "pdf", "application/pdf" },
+		{ "pfr", "application/font-tdpfr" },
+		{ "pgp", "application/pgp-encrypted" },
+		{ "pkg", "application/octet-stream" },
+		{ "pki", "application/pkixcmp" },
+		{ "pkipath", "application/pkix-pkipath" },
+		{ "pls", "application/pls+xml" },
+		{ "png", "image/png" },
+		{ "prf", "application/pics-rules" },
+		{ "ps", "application/postscript" },
+		{ "pskcxml", "application/pskc+xml" },
+		{ "qt", "video/quicktime" },
+		{ "raml", "application/raml+yaml" },
+		{ "rdf", "application/rdf+xml" },
+		{ "rif", "application/reginfo+xml" },
+		{ "rl", "application/resource-lists+xml" },
+		{ "rld", "application/resource-lists-diff+xml" },
+		{ "rmi", "audio/midi" },
+		{ "rnc", "application/relax-ng-compact-syntax" },
+		{ "rng", "application/xml" },
+		{ "roa", "application/rpki-roa" },
+		{ "roff", "text/troff" },
+		{ "rq", "application/sparql-query" },
+		{ "rs", "application/rls-services+xml" },
+		{ "rsd", "application/rsd+xml" },
+		{ "rss", "application/rss+xml" },
+		{ "rtf", "application/rtf" },
+		{ "rtx", "text/richtext" },
+		{ "s3m", "audio/s3m" },
+		{ "sbml", "application/sbml+xml" },
+		{ "scq", "application/scvp-cv-request" },
+		{ "scs", "application/scvp-cv-response" },
+		{ "sdp", "application/sdp" },
+		{ "ser", "application/java-serialized-object" },
+		{ "setpay", "application/set-payment-initiation" },
+		{ "setreg", "application/set-registration-initiation" },
+		{ "sgi", "image/sgi" },
+		{ "sgm", "text/sgml" },
+		{ "sgml", "text/sgml" },
+		{ "shex", "text/shex" },
+		{ "shf", "application/shf+xml" },
+		{ "shtml", "text/html" },
+		{ "sig", "application/pgp-signature" },
+		{ "sil", "audio/silk" },
+		{ "silo", "model/mesh" },
+		{ "slim", "text/slim" },
+		{ "slm", "text/slim" },
+		{ "smi", "application/smil+xml" },
+		{ "smil", "application/smil+xml" },
+		{ "snd", "audio/basic" },
+		{ "so", "application/octet-stream" },
+		{ "spp", "application/scvp-vp-response" },
+		{ "spq", "application/scvp-vp-request" },
+		{ "spx", "audio/ogg" },
+		{ "sru", "application/sru+xml" },
+		{ "srx", "application/sparql-results+xml" },
+		{ "ssdl", "application/ssdl+xml" },
+		{ "ssml", "application/ssml+xml" },
+		{ "stk", "application/hyperstudio" },
+		{ "styl", "text/stylus" },
+		{ "stylus", "text/stylus" },
+		{ "svg", "image/svg+xml" },
+		{ "svgz", "image/svg+xml" },
+		{ "t", "text/troff" },
+		{ "t38", "image/t38" },
+		{ "tei", "application/tei+xml" },
+		{ "teicorpus", "application/tei+xml" },
+		{ "text", "text/plain" },
+		{ "tfi", "application/thraud+xml" },
+		{ "tfx", "image/tiff-fx" },
+		{ "tif", "image/tiff" },
+		{ "tiff", "image/tiff" },
+		{ "tr", "text/troff" },
+		{ "ts", "video/mp2t" },
+		{ "tsd", "application/timestamped-data" },
+		{ "tsv", "text/tab-separated-values" },
+		{ "ttc", "font/collection" },
+		{ "ttf", "font/ttf" },
+		{ "ttl", "text/turtle" },
+		{ "txt", "text/plain" },
+		{ "u8dsn", "message/global-delivery-status" },
+		{ "u8hdr", "message/global-headers" },
+		{ "u8mdn", "message/global-disposition-notification" },
+		{ "u8msg", "message/global" },
+		{ "uri", "text/uri-list" },
+		{ "uris", "text/uri-list" },
+		{ "urls", "text/uri-list" },
+		{ "vcard", "text/vcard" },
+		{ "vrml", "model/vrml" },
+		{ "vtt", "text/vtt" },
+		{ "vxml", "application/voicexml+xml" },
+		{ "war", "application/java-archive" },
+		{ "wasm", "application/wasm" },
+		{ "wav", "audio/wav" },
+		{ "weba", "audio/webm" },
+		{ "webm", "video/webm" },
+		{ "webmanifest", "application/manifest+json" },
+		{ "webp", "image/webp" },
+		{ "wgt", "application/widget" },
+		{ "wmf", "image/wmf" },
+		{ "woff", "font/woff" },
+		{ "woff2", "font/woff2" },
+		{ "wrl", "model/vrml" },
+		{ "wsdl", "application/wsdl+xml" },
+		{ "wspolicy", "application/wspolicy+xml" },
+		{ "x3d", "model/x3d+xml" },
+		{ "x3db", "model/x3d+binary" },
+		{ "x3dbz", "model/x3d+binary" },
+		{ "x3dv", "model/x3d+vrml" },
+		{ "x3dvz", "model/x3d+vrml" },
+		{ "x3dz", "model/x3d+xml" },
+		{ "xaml", "application/xaml+xml" },
+		{ "xdf", "application/xcap-diff+xml" },
+		{ "xdssc", "application/dssc+xml" },
+		{ "xenc", "application/xenc+xml" },
+		{ "xer", "application/patch-ops-error+xml" },
+		{ "xht", "application/xhtml+xml" },
+		{ "xhtml", "application/xhtml+xml" },
+		{ "xhvml", "application/xv+xml" },
+		{ "xm", "audio/xm" },
+		{ "xml", "application/xml" },
+		{ "xop", "application/xop+xml" },
+		{ "xpl", "application/xproc+xml" },
+		{ "xsd", "application/xml" },
+		{ "xsl", "application/xml" },
+		{ "xslt", "application/xslt+xml" },
+		{ "xspf", "application/xspf+xml" },
+		{ "xvm", "application/xv+xml" },
+		{ "xvml", "application/xv+xml" },
+		{ "yaml", "text/yaml" },
+		{ "yang", "application/yang" },
+		{ "yin", "application/yin+xml" },
+		{ "yml", "text/yaml" },
+		{ "zip", "application/zip" }
 	};
 
-	std::string mimeTypeByExtension(const std::string& ext)
+	constexpr bool sortedByExtension(const MimeType* begin, const MimeType* end)
 	{
-		auto m = std::find_if(std::begin(s_mimeTypes), std::end(s_mimeTypes), [&ext](const MimeType& mime)->bool {
-			return ext == mime.extension;
+		for (auto it = begin + 1; it < end; ++it)
+		{
+			if (!((it - 1)->extension < it->extension))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static_assert(sortedByExtension(std::begin(s_mimeTypes), std::end(s_mimeTypes)), "s_mimeTypes has to be sorted by extension");
+
+	std::string_view mimeTypeByExtension(std::string_view ext)
+	{
+		auto m = std::lower_bound(std::begin(s_mimeTypes), std::end(s_mimeTypes), ext, [](const MimeType& mime, std::string_view e) {
+			return mime.extension < e;
 		});
 
-		if (m == std::end(s_mimeTypes))
+		if (m == std::end(s_mimeTypes) || m->extension != ext)
 		{
 			return "text/plain";
 		}
 
 		return m->type;
 	}
-	std::string getMimeType(const std::string& file)
+	std::string_view getMimeType(std::string_view file)
 	{
 		auto dot = file.find_last_of('.');
 		if (dot == std::string::npos)
@@ -519,25 +757,262 @@ namespace
 			return mimeTypeByExtension(file.substr(dot + 1));
 		}
 	}
-	peq::network::Data toData(const http::Response& response)
+	const char s_headEnd[] = "\r\n";
+
+	// most common types skip extension lookup
+	const Header s_textContentType(s_contentTypeHeader, "text/plain");
+	const Header s_jsonContentType(s_contentTypeHeader, "application/json");
+
+	Header* findHeader(std::vector<Header>& headers, const std::string& name)
+	{
+		for (auto& h : headers)
+		{
+			if (compare(h.name, name))
+			{
+				return &h;
+			}
+		}
+		return nullptr;
+	}
+
+	// prepared header lines parsed back to headers
+	std::vector<Header> preparedHeaders(const http::Response& response)
+	{
+		std::vector<Header> headers;
+		std::string lines(response.preparedHeaders.data, response.preparedHeaders.size);
+		size_t start = 0;
+		size_t end;
+		while ((end = lines.find("\r\n", start)) != std::string::npos)
+		{
+			auto colon = lines.find(": ", start);
+			if (colon != std::string::npos && colon < end)
+			{
+				headers.push_back(Header(lines.substr(start, colon - start), lines.substr(colon + 2, end - colon - 2)));
+			}
+			start = end + 2;
+		}
+		return headers;
+	}
+
+	std::string responseHeader(http::Response& response, const std::string& name)
+	{
+		if (auto h = findHeader(response.headers, name))
+		{
+			return h->value;
+		}
+		if (response.preparedHeaders.data)
+		{
+			auto prepared = preparedHeaders(response);
+			if (auto h = findHeader(prepared, name))
+			{
+				return h->value;
+			}
+		}
+		return std::string();
+	}
+
+	// moves prepared header lines to headers so they can be changed
+	void unprepare(http::Response& response)
+	{
+		if (!response.preparedHeaders.data)
+		{
+			return;
+		}
+		auto prepared = preparedHeaders(response);
+		response.headers.insert(response.headers.end(), prepared.begin(), prepared.end());
+		response.preparedHeaders = peq::network::SharedData();
+	}
+
+	void setHeader(std::vector<Header>& headers, const std::string& name, const std::string& value)
+	{
+		if (auto h = findHeader(headers, name))
+		{
+			h->value = value;
+		}
+		else
+		{
+			headers.push_back(Header(name, value));
+		}
+	}
+
+	void removeHeader(std::vector<Header>& headers, const std::string& name)
+	{
+		headers.erase(std::remove_if(headers.begin(), headers.end(), [&name](const Header& h) { return compare(h.name, name); }), headers.end());
+	}
+
+	void clearBody(http::Response& response)
+	{
+		response.body.clear();
+		response.sharedBody = peq::network::SharedData();
+		response.file = peq::network::FileRange();
+	}
+
+	// 304 keeps validators and caching headers but has no body
+	void toNotModified(http::Response& response)
+	{
+		unprepare(response);
+		auto headers = std::move(response.headers);
+		response.headers.clear();
+		for (auto& h : headers)
+		{
+			if (compare(h.name, s_contentLengthHeader) || compare(h.name, s_contentTypeHeader) || compare(h.name, s_contentEncodingHeader))
+			{
+				continue;
+			}
+			response.headers.push_back(std::move(h));
+		}
+		response.status = Status::NotModified;
+		clearBody(response);
+	}
+
+	// size of ranged content, 0 when response has no single body source
+	uint64_t contentSize(const http::Response& response)
+	{
+		unsigned sources = (response.file.file ? 1 : 0) + (response.sharedBody.data ? 1 : 0) + (response.body.empty() ? 0 : 1);
+		if (sources != 1)
+		{
+			return 0;
+		}
+		if (response.file.file) return response.file.size;
+		if (response.sharedBody.data) return response.sharedBody.size;
+		return response.body.size();
+	}
+
+	std::string contentRange(const ByteRange& range, uint64_t size)
+	{
+		return "bytes " + peq::string::from(range.first) + "-" + peq::string::from(range.last) + "/" + peq::string::from(size);
+	}
+
+	// narrows body to range without copying file or shared data
+	void slice(http::Response& response, const ByteRange& range)
+	{
+		if (response.file.file)
+		{
+			response.file.offset += range.first;
+			response.file.size = range.size();
+		}
+		else if (response.sharedBody.data)
+		{
+			response.sharedBody.data += range.first;
+			response.sharedBody.size = static_cast<size_t>(range.size());
+		}
+		else
+		{
+			response.body = peq::network::Data(response.body.begin() + range.first, response.body.begin() + range.first + range.size());
+		}
+	}
+
+	void compressBody(http::Response& response, const http::Request& request, size_t minimumSize)
+	{
+		if (minimumSize == 0 || response.body.size() < minimumSize)
+		{
+			return;
+		}
+		auto contentType = findHeader(response.headers, s_contentTypeHeader);
+		if (!contentType || !compressible(contentType->value) || findHeader(response.headers, s_contentEncodingHeader))
+		{
+			return;
+		}
+
+		// representation depends on Accept-Encoding also when body is sent uncompressed
+		response.headers.push_back(Header(s_varyHeader, s_acceptEncodingHeader));
+		auto encoding = acceptedEncoding(request);
+		if (encoding == Encoding::Identity || !compressionAvailable())
+		{
+			return;
+		}
+		auto compressed = compress(encoding, response.body.data(), response.body.size());
+		if (compressed.empty() || compressed.size() >= response.body.size())
+		{
+			return;
+		}
+		response.body = std::move(compressed);
+		response.headers.push_back(Header(s_contentEncodingHeader, toString(encoding)));
+		// compressed bytes differ from identity body, strong validator would claim they are the same.
+		// Weak tag still matches If-None-Match of either representation
+		auto etag = findHeader(response.headers, s_etagHeader);
+		if (etag && etag->value.compare(0, 2, "W/") != 0)
+		{
+			etag->value = "W/" + etag->value;
+		}
+		if (auto contentLength = findHeader(response.headers, s_contentLengthHeader))
+		{
+			contentLength->value = peq::string::from(response.body.size());
+		}
+	}
+
+	// status line and headers without terminating empty line, prepared headers and body are sent as separate buffers.
+	// Buffer is reused by next call on same thread, sessions may be sent to from other threads so it is not per connection
+	const std::string& toHead(const http::Response& response)
 	{
-		std::stringstream ss;
-		ss << "HTTP/" << response.version.major << "." << response.version.minor << " " << (int)response.status << " " << toString(response.status) << "\r\n";
+		thread_local std::string head;
+		head.clear();
+		auto line = statusLine(response.status);
+		if (response.version.major == 1 && response.version.minor == 1 && !line.empty())
+		{
+			head.append(line);
+		}
+		else
+		{
+			char status[32];
+			auto length = snprintf(status, sizeof(status), "HTTP/%d.%d %d ", response.version.major, response.version.minor, static_cast<int>(response.status));
+			head.append(status, static_cast<size_t>(length));
+			if (!line.empty())
+			{
+				head.append(line.substr(s_statusPrefix));
+			}
+			else
+			{
+				head.append(s_headEnd, sizeof(s_headEnd) - 1);
+			}
+		}
 		for (auto& it : response.headers)
 		{
-			ss << it.name << ": " << it.value << "\r\n";
+			head.append(it.name);
+			head.append(": ", 2);
+			head.append(it.value);
+			head.append(s_headEnd, sizeof(s_headEnd) - 1);
 		}
-		ss << "\r\n";
+		return head;
+	}
+}
 
-		auto str = ss.str();
+std::string peq::http::formatDate(uint64_t epochSeconds)
+{
+	return httpDate(epochSeconds);
+}
 
-		peq::network::Data data;
-		data.resize(str.size() + response.body.size());
-		memcpy(data.data(), str.c_str(), str.length());
-		memcpy(data.data() + str.size(), response.body.data(), response.body.size());
+uint64_t peq::http::parseDate(const std::string& date)
+{
+	// IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+	const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	char weekday[4] = { 0 };
+	char month[4] = { 0 };
+	int day, year, hour, minute, second;
+	if (sscanf(date.c_str(), "%3s, %d %3s %d %d:%d:%d", weekday, &day, month, &year, &hour, &minute, &second) != 7)
+	{
+		return 0;
+	}
+	unsigned m = 0;
+	while (m < 12 && strcmp(months[m], month) != 0) m++;
+	if (m == 12 || year < 1970 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+	{
+		return 0;
+	}
+	auto days = daysFromCivil(year, m + 1, static_cast<unsigned>(day));
+	return static_cast<uint64_t>(days * 86400 + hour * 3600 + minute * 60 + second);
+}
 
-		return data;
+std::string peq::http::fileETag(const peq::network::File& file, const std::string& suffix)
+{
+	std::stringstream ss;
+	ss << "\"" << std::hex << file.size() << "-" << file.modified();
+	if (!suffix.empty())
+	{
+		ss << "-" << suffix;
 	}
+	ss << "\"";
+	return ss.str();
 }
 
 Header Header::createKeepAliveResponse(unsigned seconds, unsigned requests)
@@ -557,7 +1032,7 @@ Header Header::createKeepAliveResponse(unsigned seconds, unsigned requests)
 
 Header Header::createContentTypeResponse(const std::string& type)
 {
-	return Header(s_contentTypeHeader, getMimeType(type) );
+	return Header(s_contentTypeHeader, std::string(getMimeType(type)));
 }
 
 Cookie Cookie::create(const std::string& cookie)
@@ -610,98 +1085,334 @@ bool Authorization::empty() const
 	return user.empty() && password.empty();
 }
 
-const Authorization Request::auth() const
+KnownHeader Headers::intern(std::string_view name)
 {
-	for (auto& h : headers)
+	for (size_t i = 0; i < static_cast<size_t>(KnownHeader::Count); i++)
 	{
-		if (h.name == s_authorizationHeader)
+		if (compare(name, s_knownHeaders[i]))
 		{
-			return Authorization(h.value);
+			return static_cast<KnownHeader>(i);
 		}
 	}
-	return Authorization();
+	return KnownHeader::Count;
 }
 
-const Apikey Request::apiKey() const
+void Headers::push_back(const Header& header)
 {
-	for (auto& h : headers)
+	_headers.push_back(header);
+	index(_headers.size() - 1);
+}
+
+void Headers::push_back(Header&& header)
+{
+	_headers.push_back(std::move(header));
+	index(_headers.size() - 1);
+}
+
+void Headers::index(size_t position)
+{
+	auto name = intern(_headers[position].name);
+	if (name != KnownHeader::Count && _index[static_cast<size_t>(name)] == 0)
+	{
+		_index[static_cast<size_t>(name)] = static_cast<uint32_t>(position + 1);
+	}
+	if (name == KnownHeader::Cookie)
+	{
+		_cookies.add(position, _headers[position].value);
+	}
+}
+
+void Headers::reserve(size_t count)
+{
+	_headers.reserve(count);
+}
+
+void Headers::clear()
+{
+	_headers.clear();
+	_index.fill(0);
+	_cookies.clear();
+}
+
+size_t Headers::size() const
+{
+	return _headers.size();
+}
+
+bool Headers::empty() const
+{
+	return _headers.empty();
+}
+
+Headers::const_iterator Headers::begin() const
+{
+	return _headers.begin();
+}
+
+Headers::const_iterator Headers::end() const
+{
+	return _headers.end();
+}
+
+const Header& Headers::operator[](size_t index) const
+{
+	return _headers[index];
+}
+
+const Header* Headers::find(KnownHeader name) const
+{
+	auto position = _index[static_cast<size_t>(name)];
+	return position == 0 ? nullptr : &_headers[position - 1];
+}
+
+const Header* Headers::find(std::string_view name) const
+{
+	auto known = intern(name);
+	if (known != KnownHeader::Count)
 	{
-		if (h.name == s_apikeyHeader)
+		return find(known);
+	}
+	for (auto& h : _headers)
+	{
+		if (compare(h.name, name))
 		{
-			return Apikey(h.value);
+			return &h;
 		}
 	}
+	return nullptr;
+}
+
+const std::string& Headers::value(KnownHeader name) const
+{
+	auto h = find(name);
+	return h ? h->value : s_empty;
+}
+
+std::string_view Headers::cookie(std::string_view name) const
+{
+	return _cookies.find(_headers, name);
+}
+
+const Authorization Request::auth() const
+{
+	if (auto h = headers.find(KnownHeader::Authorization))
+	{
+		return Authorization(h->value);
+	}
+	return Authorization();
+}
+
+const Apikey Request::apiKey() const
+{
+	if (auto h = headers.find(KnownHeader::ApiKey))
+	{
+		return Apikey(h->value);
+	}
 	return Apikey();
 }
 
 const http::Cookie Request::cookie(const std::string& cookie) const
 {
-	for (auto & h : headers)
+	auto value = headers.cookie(cookie);
+	if (value.data() == nullptr)
 	{
-		if (h.name == s_cookie)
+		return http::Cookie();
+	}
+	return Cookie(cookie, std::string(value));
+}
+
+std::string_view Request::cookieValue(std::string_view cookie) const
+{
+	return headers.cookie(cookie);
+}
+
+// Cookie: a=1; b=2
+void CookieJar::add(size_t header, std::string_view value)
+{
+	const auto begin = value.data();
+	while (!value.empty())
+	{
+		auto semicolon = value.find(';');
+		auto pair = value.substr(0, semicolon);
+		value = semicolon == std::string_view::npos ? std::string_view() : value.substr(semicolon + 1);
+
+		auto start = pair.find_first_not_of(" \t");
+		auto equal = pair.find('=');
+		if (start == std::string_view::npos || equal == std::string_view::npos || equal <= start)
 		{
-			if (cookie.size() > h.value.size()) continue;
-		
-			std::istringstream st(h.value);
-			std::string tmp;
-			while (std::getline(st, tmp, ';'))
-			{
-				if (tmp.empty())
-				{
-					continue;
-				}
+			continue;
+		}
+		auto offset = static_cast<uint32_t>(pair.data() - begin);
+		_cookies.push_back({ static_cast<uint32_t>(header), offset + static_cast<uint32_t>(start), static_cast<uint32_t>(equal - start),
+			offset + static_cast<uint32_t>(equal + 1), static_cast<uint32_t>(pair.size() - equal - 1) });
+	}
+}
 
-				auto offset = 0;
-				if (tmp[0] == ' ')
-				{
-					offset = 1;
-				}
-				
-				auto equalp = tmp.find('=');
-				if (equalp == std::string::npos) continue;
-				if (equalp <= offset) continue;
+void CookieJar::clear()
+{
+	_cookies.clear();
+}
 
-				auto sub = tmp.substr(offset, equalp - offset);
-				if (sub == cookie)
-				{
-					return Cookie::create(tmp.c_str() + offset);
-				}
-			}
+std::string_view CookieJar::find(const std::vector<Header>& headers, std::string_view name) const
+{
+	for (auto& c : _cookies)
+	{
+		std::string_view value = headers[c.header].value;
+		if (value.substr(c.name, c.nameLength) == name)
+		{
+			return value.substr(c.value, c.valueLength);
 		}
 	}
-	return http::Cookie();
+	return std::string_view();
 }
 
 bool Request::wantsToKeepAlive() const
 {
-	for (auto& h : headers)
+	return compare(headers.value(KnownHeader::Connection), s_keepAliveValue);
+}
+
+bool Request::notModified(const std::string& etag, uint64_t lastModified) const
+{
+	if (auto h = headers.find(KnownHeader::IfNoneMatch))
 	{
-		if (compare(h.name, s_connectionHeader) &&  compare(h.value, s_keepAliveValue))
+		// If-None-Match takes precedence over If-Modified-Since
+		if (etag.empty()) return false;
+		std::istringstream st(h->value);
+		std::string tag;
+		while (std::getline(st, tag, ','))
 		{
-			return true;
+			auto start = tag.find_first_not_of(" \t");
+			auto end = tag.find_last_not_of(" \t");
+			if (start == std::string::npos) continue;
+			tag = tag.substr(start, end - start + 1);
+			if (tag == "*" || opaqueTag(tag) == opaqueTag(etag))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	if (lastModified == 0 || (method != Method::GET && method != Method::HEAD))
+	{
+		return false;
+	}
+	if (auto h = headers.find(KnownHeader::IfModifiedSince))
+	{
+		auto since = parseDate(h->value);
+		return since != 0 && lastModified <= since;
+	}
+	return false;
+}
+
+std::optional<std::vector<ByteRange>> Request::ranges(uint64_t contentSize, const std::string& etag, uint64_t lastModified) const
+{
+	auto range = headers.find(KnownHeader::Range);
+	auto ifRange = headers.find(KnownHeader::IfRange);
+	if (!range || method != Method::GET)
+	{
+		return std::nullopt;
+	}
+
+	if (ifRange)
+	{
+		// range applies only to unchanged representation, otherwise full content is sent
+		auto value = trim(ifRange->value);
+		if (!value.empty() && (value[0] == '"' || value.compare(0, 2, "W/") == 0))
+		{
+			// strong comparison, weak tags never match
+			if (value[0] != '"' || value != etag) return std::nullopt;
+		}
+		else
+		{
+			auto date = parseDate(value);
+			if (date == 0 || date != lastModified) return std::nullopt;
+		}
+	}
+
+	auto value = trim(range->value);
+	if (value.size() < 6 || !compare(value.substr(0, 6), "bytes="))
+	{
+		return std::nullopt;
+	}
+
+	std::vector<ByteRange> result;
+	std::istringstream st(value.substr(6));
+	std::string spec;
+	unsigned count = 0;
+	while (std::getline(st, spec, ','))
+	{
+		spec = trim(spec);
+		if (spec.empty()) continue;
+		if (++count > s_maxRanges) return std::nullopt;
+
+		auto dash = spec.find('-');
+		if (dash == std::string::npos) return std::nullopt;
+		auto firstStr = spec.substr(0, dash);
+		auto lastStr = spec.substr(dash + 1);
+		uint64_t first = 0;
+		uint64_t last = 0;
+		if (firstStr.empty())
+		{
+			// suffix range: last n bytes
+			uint64_t suffix = 0;
+			if (!parseNumber(lastStr, suffix)) return std::nullopt;
+			if (suffix == 0 || contentSize == 0) continue;
+			first = suffix >= contentSize ? 0 : contentSize - suffix;
+			last = contentSize - 1;
+		}
+		else
+		{
+			if (!parseNumber(firstStr, first)) return std::nullopt;
+			if (lastStr.empty())
+			{
+				last = contentSize - 1;
+			}
+			else
+			{
+				if (!parseNumber(lastStr, last) || last < first) return std::nullopt;
+				last = std::min(last, contentSize - 1);
+			}
+			if (first >= contentSize) continue;
+		}
+		result.push_back({ first, last });
+	}
+	if (count == 0)
+	{
+		return std::nullopt;
+	}
+
+	if (result.size() > 1)
+	{
+		// overlapping or adjacent ranges are sent once
+		std::sort(result.begin(), result.end(), [](const ByteRange& a, const ByteRange& b) { return a.first < b.first; });
+		std::vector<ByteRange> merged;
+		for (auto& r : result)
+		{
+			if (!merged.empty() && r.first <= merged.back().last + 1)
+			{
+				merged.back().last = std::max(merged.back().last, r.last);
+			}
+			else
+			{
+				merged.push_back(r);
+			}
 		}
+		result = std::move(merged);
 	}
-	return false;
+	return result;
 }
 
 bool Request::wantsToClose() const
 {
-	for (auto& h : headers)
-	{
-		if (compare(h.name, s_connectionHeader) && compare(h.value, s_closeValue))
-		{
-			return true;
-		}
-	}
-	return false;
+	return compare(headers.value(KnownHeader::Connection), s_closeValue);
 }
 
 Response Response::createText(Status status, const std::string& content)
 {
-	peq::network::Data d;
-	d.resize(content.size());
-	memcpy(d.data(), content.c_str(), content.size());
-	return http::Response::create(status, "text", std::move(d));
+	Response r(status, peq::network::Data(content.begin(), content.end()));
+	r.headers.push_back(s_textContentType);
+	return r;
 }
 
 Response Response::createEventStream(Status status)
@@ -713,10 +1424,9 @@ Response Response::createEventStream(Status status)
 
 Response Response::createJson(Status status, const std::string& content)
 {
-	peq::network::Data d;
-	d.resize(content.size());
-	memcpy(d.data(), content.c_str(), content.size());
-	return http::Response::create(status, "json", std::move(d));
+	Response r(status, peq::network::Data(content.begin(), content.end()));
+	r.headers.push_back(s_jsonContentType);
+	return r;
 }
 
 Response Response::createFromFilename(Status status, const std::string& filename, peq::network::Data &&content)
@@ -726,6 +1436,24 @@ Response Response::createFromFilename(Status status, const std::string& filename
 	return http::Response::create(status, e, std::forward<peq::network::Data>(content));
 }
 
+Response Response::createFromFile(Status status, const std::string& filename)
+{
+	auto file = peq::network::File::open(filename);
+	if (!file)
+	{
+		return Response(Status::NotFound);
+	}
+
+	std::filesystem::path filePath = std::filesystem::u8path(filename.data());
+	auto r = http::Response::create(status, filePath.extension().u8string());
+	r.headers.push_back(http::Header(s_contentLengthHeader, peq::string::from(file->size())));
+	r.headers.push_back(http::Header(s_etagHeader, fileETag(*file)));
+	r.headers.push_back(http::Header(s_lastModifiedHeader, formatDate(file->modified())));
+	r.headers.push_back(http::Header(s_acceptRangesHeader, "bytes"));
+	r.file = { file, 0, file->size() };
+	return r;
+}
+
 Response Response::create(Status status, const std::string& type, peq::network::Data&& content)
 {
 	Response r(status, std::forward<peq::network::Data>(content));
@@ -748,7 +1476,7 @@ Response::Response(Status stat, peq::network::Data&& content)
 	status = stat;
 	headers.push_back(http::Header(s_dateHeader, httpDateNow()));
 	headers.push_back(http::Header(s_contentLengthHeader, content.size()));
-	body = content;
+	body = std::move(content);
 }
 
 Response::Response(Status stat)
@@ -806,6 +1534,13 @@ void Response::setCookie(const Cookie& cookie)
 Router& Router::set(Method method, const std::string& route,
 	std::function<Response(const Request&)> func,
 	std::function<bool(const http::Request&)> authFunc)
+{
+	return set(method, route, [func](const Request& request, const Parameters&) { return func(request); }, authFunc);
+}
+
+Router& Router::set(Method method, const std::string& route,
+	std::function<Response(const Request&, const Parameters&)> func,
+	std::function<bool(const http::Request&)> authFunc)
 {
 	Url url(route);
 
@@ -821,25 +1556,121 @@ Router& Router::set(Method method, const std::string& route,
 	}
 
 	std::sort(handle.params.begin(), handle.params.end());
+	handle.signature = routeSignature(method, hashKeys(handle.params));
+
+	// compile path to segments, anything that is not literal or {name:type} capture is left to regex
+	std::vector<Node> segments;
+	bool regex = false;
+	for (auto& str : splitPath(url.path))
+	{
+		Node segment;
+		if (str.size() > 2 && str.front() == '{' && str.back() == '}')
+		{
+			auto inner = str.substr(1, str.size() - 2);
+			auto colon = inner.find(':');
+			segment.segment = inner.substr(0, colon);
+			auto type = colon == std::string::npos ? std::string() : inner.substr(colon + 1);
+			if (type.empty() || type == "string") segment.capture = Node::Capture::String;
+			else if (type == "int") segment.capture = Node::Capture::Int;
+			if (segment.capture == Node::Capture::None || !isIdentifier(segment.segment))
+			{
+				regex = true;
+				break;
+			}
+		}
+		else if (str.find_first_of(s_regexCharacters) != std::string::npos)
+		{
+			regex = true;
+			break;
+		}
+		else
+		{
+			segment.segment = str;
+		}
+		segments.push_back(std::move(segment));
+	}
 
-	for (auto &h : _handles)
-	{	
-		if (handle.method == h.method && handle.path == h.path)
+	if (regex)
+	{
+		for (auto i : _regexHandles)
 		{
-			bool differentparams = false;
-			if (h.params.size() == handle.params.size() &&
-				std::equal(h.params.begin(), h.params.end(), handle.params.begin()))
+			auto& h = _handles[i];
+			if (handle.method == h.method && handle.path == h.path && h.params == handle.params)
 			{
 				assert(0 && "handler already exists");
 				return *this;
 			}
 		}
+		// compiled once here instead of on every request
+		handle.isRegex = true;
+		handle.regex = std::regex(handle.path);
+		_regexHandles.push_back(_handles.size());
+		_handles.push_back(std::move(handle));
+		return *this;
+	}
+
+	Node* node = &_root;
+	for (auto& segment : segments)
+	{
+		auto& children = node->children;
+		std::vector<Node>::iterator it;
+		if (segment.capture == Node::Capture::None)
+		{
+			auto literalEnd = children.begin() + node->literals;
+			it = std::lower_bound(children.begin(), literalEnd, segment.segment, [](const Node& n, const std::string& s) {
+				return n.segment < s;
+			});
+			if (it == literalEnd || it->segment != segment.segment)
+			{
+				it = children.insert(it, std::move(segment));
+				node->literals++;
+			}
+		}
+		else
+		{
+			it = std::find_if(children.begin() + node->literals, children.end(), [&segment](const Node& n) {
+				return n.capture == segment.capture && n.segment == segment.segment;
+			});
+			if (it == children.end())
+			{
+				// int captures are tried before string captures
+				auto position = segment.capture == Node::Capture::Int ? children.begin() + node->literals : children.end();
+				it = children.insert(position, std::move(segment));
+			}
+		}
+		node = &*it;
+	}
+
+	auto range = node->dispatch.equal_range(handle.signature);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		auto& h = _handles[it->second];
+		if (handle.method == h.method && h.params == handle.params)
+		{
+			assert(0 && "handler already exists");
+			return *this;
+		}
 	}
 
+	node->dispatch.emplace(handle.signature, _handles.size());
 	_handles.push_back(std::move(handle));
 	return *this;
 }
 
+Router& Router::setStream(Method method, const std::string& route,
+	std::function<std::shared_ptr<BodyStream>(const Request&, const Parameters&)> streamFunc,
+	std::function<Response(const Request&, const Parameters&)> func,
+	std::function<bool(const http::Request&)> authFunc)
+{
+	auto count = _handles.size();
+	set(method, route, func, authFunc);
+	if (_handles.size() > count)
+	{
+		_handles.back().streamFunc = streamFunc;
+	}
+	return *this;
+}
+
 Parameters::Parameters(const std::string& url)
 {
 	//aaaa?b=4&d=4
@@ -925,147 +1756,504 @@ std::vector<std::string> Parameters::keys() const
 	return p;
 }
 
-Url::Url(const std::string& fullUrl)
+uint64_t Parameters::keysHash() const
+{
+	uint64_t hash = s_fnvOffset;
+	for (auto& it : _params)
+	{
+		hash = hashKey(hash, it.first);
+	}
+	return hash;
+}
+
+bool Parameters::hasKeys(const std::vector<std::string>& sortedKeys) const
+{
+	return _params.size() == sortedKeys.size() &&
+		std::equal(_params.begin(), _params.end(), sortedKeys.begin(), [](const std::pair<const std::string, std::string>& p, const std::string& key) {
+			return p.first == key;
+		});
+}
+
+Url::Url(const std::string& fullUrl)
+{
+	full = fullUrl;
+	auto start = fullUrl.find('?');
+	if (start == std::string::npos)
+	{
+		path = fullUrl;
+	}
+	else
+	{
+		path = fullUrl.substr(0, start);
+		params = Parameters(fullUrl);
+	}
+}
+
+std::string_view RequestView::header(std::string_view name) const
+{
+	for (auto& h : headers)
+	{
+		if (compare(h.name, name))
+		{
+			return h.value;
+		}
+	}
+	return std::string_view();
+}
+
+std::string_view RequestView::param(std::string_view key) const
+{
+	for (auto it = params.rbegin(); it != params.rend(); ++it)
+	{
+		if (it->first == key)
+		{
+			return it->second;
+		}
+	}
+	return std::string_view();
+}
+
+Request RequestView::toRequest() const
+{
+	Request r;
+	r.method = method;
+	r.version = version;
+	r.url = Url(std::string(url));
+	r.headers.reserve(headers.size());
+	for (auto& h : headers)
+	{
+		r.headers.push_back(Header(std::string(h.name), std::string(h.value)));
+	}
+	r.body.assign(body.begin(), body.end());
+	r.info = info;
+	r.secure = secure;
+	return r;
+}
+
+Router& Router::setDefault(std::function<Response(const Request&)> func)
+{
+	_defaultFunc = func;
+	return *this;
+}
+
+Response Router::route(const Request& request)
+{
+	auto endpointFound = false;
+	Parameters captures;
+	auto index = resolve(request, captures, endpointFound);
+	if (index != s_noHandle)
+	{
+		return dispatch(_handles[index], request, captures);
+	}
+
+	if (_defaultFunc != nullptr)
+	{
+		return _defaultFunc(request);
+	}
+
+	if (endpointFound)
+	{
+		return Response::createText(peq::http::Status::BadRequest, "Action not found");
+	}
+	else
+	{
+		return Response::createText(peq::http::Status::NotFound, "Resource not found");
+	}
+}
+
+std::shared_ptr<BodyStream> Router::stream(const Request& request) const
+{
+	auto endpointFound = false;
+	Parameters captures;
+	auto index = resolve(request, captures, endpointFound);
+	if (index == s_noHandle || !_handles[index].streamFunc)
+	{
+		return nullptr;
+	}
+	auto& handle = _handles[index];
+	// unauthorized upload is not streamed, route answers it when request is complete
+	if (handle.authFunc && !handle.authFunc(request))
+	{
+		return nullptr;
+	}
+	return handle.streamFunc(request, captures);
+}
+
+size_t Router::resolve(const Request& request, Parameters& captures, bool& endpointFound) const
+{
+	Captures segments;
+	auto signature = routeSignature(request.method, request.url.params.keysHash());
+	auto index = match(_root, splitPath(request.url.path), 0, signature, request, segments, endpointFound);
+	if (index != s_noHandle)
+	{
+		for (auto& c : segments)
+		{
+			captures.set(c.first, c.second);
+		}
+		return index;
+	}
+
+	for (auto i : _regexHandles)
+	{
+		auto& it = _handles[i];
+		if (std::regex_match(request.url.path, it.regex))
+		{
+			endpointFound = true;
+			if (accepts(it, signature, request))
+			{
+				return i;
+			}
+		}
+	}
+	return s_noHandle;
+}
+
+size_t Router::find(const Node& node, uint64_t signature, const Request& request) const
+{
+	auto range = node.dispatch.equal_range(signature);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (accepts(_handles[it->second], signature, request))
+		{
+			return it->second;
+		}
+	}
+	return s_noHandle;
+}
+
+size_t Router::match(const Node& node, const std::vector<std::string>& segments, size_t index,
+	uint64_t signature, const Request& request, Captures& captures, bool& endpointFound) const
+{
+	if (index == segments.size())
+	{
+		if (node.dispatch.empty())
+		{
+			return s_noHandle;
+		}
+		endpointFound = true;
+		return find(node, signature, request);
+	}
+
+	// literal segment wins, captures are tried when literal path does not lead to handler
+	auto& segment = segments[index];
+	auto literalEnd = node.children.begin() + node.literals;
+	auto it = std::lower_bound(node.children.begin(), literalEnd, segment, [](const Node& n, const std::string& s) {
+		return n.segment < s;
+	});
+	if (it != literalEnd && it->segment == segment)
+	{
+		auto result = match(*it, segments, index + 1, signature, request, captures, endpointFound);
+		if (result != s_noHandle)
+		{
+			return result;
+		}
+	}
+
+	if (segment.empty())
+	{
+		return s_noHandle;
+	}
+	for (auto child = literalEnd; child != node.children.end(); ++child)
+	{
+		if (child->capture == Node::Capture::Int && !isInteger(segment))
+		{
+			continue;
+		}
+		captures.emplace_back(child->segment, segment);
+		auto result = match(*child, segments, index + 1, signature, request, captures, endpointFound);
+		if (result != s_noHandle)
+		{
+			return result;
+		}
+		captures.pop_back();
+	}
+	return s_noHandle;
+}
+
+// signature match is confirmed against names to rule out hash collisions
+bool Router::accepts(const Handle& handle, uint64_t signature, const Request& request) const
+{
+	return handle.signature == signature && handle.method == request.method && request.url.params.hasKeys(handle.params);
+}
+
+Response Router::dispatch(const Handle& handle, const Request& request, const Parameters& captures) const
+{
+	if (handle.authFunc)
+	{
+		if (!handle.authFunc(request)) {
+			return Response::createText(peq::http::Status::Unauthorized, "");
+		}
+	}
+	return handle.func(request, captures);
+}
+
+HttpSession::HttpSession() : Session(), _keepAlive(false), _keepAliveTimeout(15), _keepAlivemMaxRequests(1000), _timeout(10), _requests(0), _compressionMinimumSize(1024), _parseMode(ParseMode::Request),
+	_buffer(peq::network::receiveBufferSize)
+{
+	_parseState.limit = defaultMaxRequestSize;
+	llhttp_settings_init(&_settings);
+	_settings.on_message_complete = &handleOnMessageComplete;
+	_settings.on_headers_complete = &handleOnHeadersComplete;
+	_settings.on_header_field = &handleOnHeaderField;
+	_settings.on_header_value = &handleOnHeaderValue;
+	_settings.on_header_value_complete = &handleOnHeaderValueComplete;
+	_settings.on_header_field_complete = &handleOnHeaderFieldComplete;
+	_settings.on_url = &handleOnUrl;
+	_settings.on_body = &handleOnBody;
+	llhttp_init(&_parser, HTTP_BOTH, &_settings);
+	_parser.data = this;
+	resetIdle();
+	peq::log::debug("http session created");
+}
+
+HttpSession::~HttpSession()
+{
+	peq::log::debug("http session destroyed");
+}
+
+void HttpSession::dataAvailable()
+{
+	auto received = receive(_buffer.data(), static_cast<unsigned>(_buffer.size()));
+	if (received <= 0)
+	{
+		return;
+	}
+
+	if (_chunked != Chunked::None)
+	{
+		// requests pipelined behind streaming response wait for endChunked
+		if (_pending.size() + static_cast<size_t>(received) > _parseState.limit)
+		{
+			peq::log::error("too much data pipelined behind chunked response");
+			disconnect();
+			return;
+		}
+		_pending.insert(_pending.end(), _buffer.data(), _buffer.data() + received);
+	}
+	else
+	{
+		parse(_buffer.data(), static_cast<size_t>(received));
+	}
+
+	// full read means more is likely waiting, larger buffer takes uploads in fewer reads
+	if (static_cast<size_t>(received) == _buffer.size() && _buffer.size() < _maxReceiveBufferSize)
+	{
+		_buffer.resize(std::min(_buffer.size() * 2, _maxReceiveBufferSize));
+	}
+}
+
+void HttpSession::parse(const char* data, size_t remaining)
+{
+	_parsing = true;
+	bool corked = false;
+	while (true)
+	{
+		auto err = llhttp_execute(&_parser, data, remaining);
+		if (err == HPE_PAUSED)
+		{
+			// parser stops after each complete request, rest of buffer may hold next pipelined request
+			auto consumed = static_cast<size_t>(llhttp_get_error_pos(&_parser) - data);
+			llhttp_resume(&_parser);
+			data += consumed;
+			remaining -= consumed;
+			if (remaining > 0 && !corked)
+			{
+				// pipelined requests, their responses are collected and written together
+				cork();
+				corked = true;
+			}
+			if (!handleRequest() || remaining == 0)
+			{
+				break;
+			}
+			if (_chunked != Chunked::None)
+			{
+				// handler is streaming response, next request is parsed after endChunked
+				_pending.assign(data, data + remaining);
+				break;
+			}
+			continue;
+		}
+
+		if (err != HPE_OK && _parseState.tooLarge)
+		{
+			reject(http::Status::PayloadTooLarge, "Request too large");
+		}
+		else if (err != HPE_OK && _parseState.streamAborted)
+		{
+			reject(http::Status::BadRequest, "Request body rejected");
+		}
+		break;
+	}
+	if (corked)
+	{
+		uncork();
+	}
+	_parsing = false;
+}
+
+bool HttpSession::handleRequest()
 {
-	full = fullUrl;
-	auto start = fullUrl.find('?');
-	if (start == std::string::npos)
+	peq::log::debug("http request received");
+	if (_parseMode == ParseMode::View)
 	{
-		path = fullUrl;
+		makeView();
 	}
 	else
 	{
-		path = fullUrl.substr(0, start);
-		params = Parameters(fullUrl);
+		// url and headers were copied when headers completed, body was appended directly to request
+		if (_bodyStream)
+		{
+			_bodyStream->end();
+			_currentRequest.bodyStream = std::move(_bodyStream);
+		}
 	}
-}
-
-Router& Router::setDefault(std::function<Response(const Request&)> func)
-{
-	_defaultFunc = func;
-	return *this;
-}
+	_currentRequest.method = _parseState.method;
+	_currentRequest.version = _parseState.version;
+	_currentRequest.info = info();
+	_currentRequest.secure = secure();
+	_requests++;
 
-Response Router::route(const Request& request)
-{
-	auto endpointFound = false;
-	for (auto& it : _handles)
+	if (_parseState.version.major == 1 && _parseState.version.minor == 0)
 	{
-		auto match = std::regex_match(request.url.path, std::regex(it.path));
-		if (match) endpointFound = true;
-
-		if (it.method == request.method && match)
+		// http 1.0 close by default
+		if (_currentRequest.wantsToKeepAlive())
 		{
-			bool found = true;
-			auto requestParamKeys = request.url.params.keys();
-			if (requestParamKeys.size() != it.params.size()) continue;
+			_keepAlive = true;
+		}
+	}
+	else if (_parseState.version.major == 1 && _parseState.version.minor == 1)
+	{
+		// http 1.1 keep-alive by default
+		_keepAlive = true;
 
-			std::sort(requestParamKeys.begin(), requestParamKeys.end());
-			if (std::equal(requestParamKeys.begin(), requestParamKeys.end(), it.params.begin()))
-			{
-				if (it.authFunc)
-				{
-					if (!it.authFunc(request)) {
-						return Response::createText(peq::http::Status::Unauthorized, "");
-					}
-				}
-				return it.func(request);
-			}	
+		if (_currentRequest.wantsToClose())
+		{
+			_keepAlive = false;
 		}
 	}
 
-	if (_defaultFunc != nullptr)
+	resetIdle();
+
+	if (_parseMode == ParseMode::View)
 	{
-		return _defaultFunc(request);
+		httpRequestViewAvailable(_currentView);
+	}
+	else
+	{
+		httpRequestAvailable(_currentRequest);
 	}
 
-	if (endpointFound)
+	// views point to arena so it is reset only after handler
+	_parseState.reset();
+
+	if (!_keepAlive || _requests > _keepAlivemMaxRequests)
 	{
-		return Response::createText(peq::http::Status::BadRequest, "Action not found");
+		// streaming handler disconnects with endChunked
+		if (_chunked == Chunked::None)
+		{
+			disconnect();
+		}
+		return false;
 	}
-	else
+	return true;
+}
+
+void HttpSession::makeRequest()
+{
+	_currentRequest = http::Request();
+	_currentRequest.method = (http::Method)_parser.method;
+	_currentRequest.version.major = _parser.http_major;
+	_currentRequest.version.minor = _parser.http_minor;
+	_currentRequest.url = http::Url(std::string(_parseState.view(_parseState.url)));
+	_currentRequest.headers.reserve(_parseState.headers.size());
+	for (auto& h : _parseState.headers)
 	{
-		return Response::createText(peq::http::Status::NotFound, "Resource not found");
+		_currentRequest.headers.push_back(http::Header(std::string(_parseState.view(h.first)), std::string(_parseState.view(h.second))));
 	}
+	_currentRequest.info = info();
+	_currentRequest.secure = secure();
 }
 
-HttpSession::HttpSession() : Session(), _keepAlive(false), _keepAliveTimeout(15), _keepAlivemMaxRequests(1000), _timeout(10), _requests(0)
+void HttpSession::httpRequestAvailable(const http::Request&)
 {
-	llhttp_settings_init(&_settings);
-	_settings.on_message_complete = &handleOnMessageComplete;
-	_settings.on_headers_complete = &handleOnHeadersComplete;
-	_settings.on_header_field = &handleOnHeaderField;
-	_settings.on_header_value = &handleOnHeaderValue;
-	_settings.on_header_value_complete = &handleOnHeaderValueComplete;
-	_settings.on_header_field_complete = &handleOnHeaderFieldComplete;
-	_settings.on_url = &handleOnUrl;
-	_settings.on_body = &handleOnBody;
-	llhttp_init(&_parser, HTTP_BOTH, &_settings);
-	_parser.data = this;
-	resetIdle();
-	peq::log::debug("http session created");
+	send(http::Response::createText(http::Status::NotImplemented, "Not Implemented"));
 }
 
-HttpSession::~HttpSession()
+void HttpSession::httpRequestViewAvailable(const http::RequestView&)
 {
-	peq::log::debug("http session destroyed");
+	send(http::Response::createText(http::Status::NotImplemented, "Not Implemented"));
 }
 
-void HttpSession::dataAvailable()
+void HttpSession::reject(http::Status status, const std::string& reason)
+{
+	peq::log::warning("http request rejected: " + reason);
+	_bodyStream = nullptr;
+	// send() decides connection headers from current request
+	_currentRequest = http::Request();
+	_currentRequest.version.major = _parser.http_major;
+	_currentRequest.version.minor = _parser.http_minor;
+	_currentRequest.headers.push_back(http::Header(s_connectionHeader, s_closeValue));
+	_keepAlive = false;
+	send(http::Response::createText(status, reason));
+	_parseState.reset();
+	disconnect();
+}
+
+void HttpSession::makeView()
 {
-	auto received = receive(_buffer, peq::network::receiveBufferSize);
-	if (received > 0)
+	auto& v = _currentView;
+	v.method = _parseState.method;
+	v.version = _parseState.version;
+	v.url = _parseState.view(_parseState.url);
+	auto question = v.url.find('?');
+	v.path = v.url.substr(0, question);
+	v.query = question == std::string_view::npos ? std::string_view() : v.url.substr(question + 1);
+
+	// vectors are cleared, not released, so steady state request does not allocate
+	v.params.clear();
+	auto query = v.query;
+	while (!query.empty())
 	{
-		auto err = llhttp_execute(&_parser, _buffer, received);
-		if (err == HPE_OK)
+		auto amp = query.find('&');
+		auto pair = query.substr(0, amp);
+		query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+		if (pair.empty()) continue;
+		auto equal = pair.find('=');
+		if (equal == std::string_view::npos)
 		{
-			if (_parseState.complete)
-			{
-				peq::log::debug("http request received");
-				_currentRequest = http::Request();
-				_currentRequest.method = _parseState.method;
-				_currentRequest.url = std::move(_parseState.url);
-				_currentRequest.headers = std::move(_parseState.headers);
-
-				_currentRequest.body.resize(_parseState.bodyLength);
-				memcpy(_currentRequest.body.data(), _parseState.bodyStart, _parseState.bodyLength);
-				_currentRequest.version = std::move(_parseState.version);
-				_currentRequest.info = info();
-				_currentRequest.secure = secure();
-				_requests++;
-
-				if (_parseState.version.major == 1 && _parseState.version.minor == 0)
-				{
-					// http 1.0 close by default
-					if (_currentRequest.wantsToKeepAlive())
-					{
-						_keepAlive = true;
-					}
-				}
-				else if (_parseState.version.major == 1 && _parseState.version.minor == 1)
-				{
-					// http 1.1 keep-alive by default
-					_keepAlive = true;
-
-					if (_currentRequest.wantsToClose())
-					{
-						_keepAlive = false;
-					}
-				}
-
-				_parseState = ParseState();
-				
-				resetIdle();
-
-				httpRequestAvailable(_currentRequest);
+			v.params.emplace_back(pair, std::string_view());
+		}
+		else
+		{
+			v.params.emplace_back(pair.substr(0, equal), pair.substr(equal + 1));
+		}
+	}
 
-				if (!_keepAlive || _requests > _keepAlivemMaxRequests)
-				{
-					disconnect();
-				}
-			}
+	v.headers.clear();
+	_currentRequest.headers.clear();
+	for (auto& h : _parseState.headers)
+	{
+		http::HeaderView header = { _parseState.view(h.first), _parseState.view(h.second) };
+		v.headers.push_back(header);
+		// send() negotiates keep-alive, caching, ranges and compression from these
+		switch (http::Headers::intern(header.name))
+		{
+		case http::KnownHeader::Connection:
+		case http::KnownHeader::IfNoneMatch:
+		case http::KnownHeader::IfModifiedSince:
+		case http::KnownHeader::Range:
+		case http::KnownHeader::IfRange:
+		case http::KnownHeader::AcceptEncoding:
+			_currentRequest.headers.push_back(http::Header(std::string(header.name), std::string(header.value)));
+			break;
+		default:
+			break;
 		}
 	}
+	v.body = _parseState.view(_parseState.body);
+	v.info = info();
+	v.secure = secure();
 }
 
 void HttpSession::resetIdle()
@@ -1079,14 +2267,103 @@ int HttpSession::send(const char* data, unsigned dataLength)
 	return Session::send(data, dataLength);
 }
 
+int HttpSession::send(const peq::network::ConstBuffer* buffers, unsigned count)
+{
+	resetIdle();
+	return Session::send(buffers, count);
+}
+
 int HttpSession::send(http::Response& response)
 {
-	if (response.headers.empty() && response.body.empty())
+	if (response.headers.empty() && response.body.empty() && !response.file.file && !response.sharedBody.data)
 	{
 		return 0;
 	}
+	if (_chunked != Chunked::None)
+	{
+		peq::log::error("response can not be sent before chunked response has ended");
+		return -1;
+	}
+
+	connectionHeaders(response);
+
+	if (response.status == Status::OK && (_currentRequest.method == Method::GET || _currentRequest.method == Method::HEAD))
+	{
+		// body is not sent (or read from disk) when client cache is up to date
+		auto etag = responseHeader(response, s_etagHeader);
+		auto lastModified = responseHeader(response, s_lastModifiedHeader);
+		if ((!etag.empty() || !lastModified.empty()) && _currentRequest.notModified(etag, parseDate(lastModified)))
+		{
+			toNotModified(response);
+		}
+	}
+
+	if (response.status == Status::OK && responseHeader(response, s_acceptRangesHeader) == "bytes")
+	{
+		auto size = contentSize(response);
+		auto ranges = size > 0 ? _currentRequest.ranges(size, responseHeader(response, s_etagHeader), parseDate(responseHeader(response, s_lastModifiedHeader))) : std::nullopt;
+		if (ranges)
+		{
+			unprepare(response);
+			if (ranges->empty())
+			{
+				response.status = Status::RangeNotSatisfiable;
+				clearBody(response);
+				setHeader(response.headers, s_contentRangeHeader, "bytes */" + peq::string::from(size));
+				setHeader(response.headers, s_contentLengthHeader, "0");
+			}
+			else if (ranges->size() == 1)
+			{
+				auto& range = ranges->front();
+				response.status = Status::PartialContent;
+				slice(response, range);
+				setHeader(response.headers, s_contentRangeHeader, contentRange(range, size));
+				setHeader(response.headers, s_contentLengthHeader, peq::string::from(range.size()));
+			}
+			else
+			{
+				return sendRanges(response, *ranges);
+			}
+		}
+	}
+
+	// partial content is a slice of identity body, compressing it would not match Content-Range
+	if (response.status == Status::OK)
+	{
+		compressBody(response, _currentRequest, _compressionMinimumSize);
+	}
+
+	auto& head = toHead(response);
+	peq::network::ConstBuffer buffers[] = {
+		{ head.data(), head.size() },
+		{ response.preparedHeaders.data, response.preparedHeaders.size },
+		{ s_headEnd, sizeof(s_headEnd) - 1 },
+		{ response.body.data(), response.body.size() },
+		{ response.sharedBody.data, response.sharedBody.size }
+	};
+	const unsigned count = sizeof(buffers) / sizeof(buffers[0]);
 
+	peq::log::debug("http response sent");
+
+	int64_t sent = 0;
+	if (response.file.file)
+	{
+		sent = Session::sendFile(buffers, count, response.file);
+	}
+	else if (response.sharedBody.data)
+	{
+		// shared body is last buffer, pass it with owner so unsent part is not copied
+		sent = Session::sendShared(buffers, count - 1, response.sharedBody);
+	}
+	else
+	{
+		sent = Session::send(buffers, count);
+	}
+	return sent < 0 ? -1 : static_cast<int>(std::min<int64_t>(sent, std::numeric_limits<int>::max()));
+}
 
+void HttpSession::connectionHeaders(http::Response& response)
+{
 	if (_currentRequest.version.major == 1 && _currentRequest.version.minor == 0)
 	{
 		if (_currentRequest.wantsToKeepAlive())
@@ -1117,14 +2394,193 @@ int HttpSession::send(http::Response& response)
 			}
 		}
 	}
+}
+
+int HttpSession::beginChunked(http::Response& response)
+{
+	if (_chunked != Chunked::None)
+	{
+		peq::log::error("chunked response already in progress");
+		return -1;
+	}
+
+	connectionHeaders(response);
+	unprepare(response);
+	removeHeader(response.headers, s_contentLengthHeader);
+	if (_currentRequest.version.major == 1 && _currentRequest.version.minor == 0)
+	{
+		// http 1.0 has no chunked encoding, end of body is marked by closing connection
+		_keepAlive = false;
+		removeHeader(response.headers, s_keepAliveHeader);
+		setHeader(response.headers, s_connectionHeader, s_closeValue);
+		_chunked = Chunked::Raw;
+	}
+	else
+	{
+		setHeader(response.headers, s_transferEncodingHeader, "chunked");
+		_chunked = Chunked::Encoded;
+	}
+	if (_currentRequest.method == Method::HEAD)
+	{
+		_chunked = Chunked::Head;
+	}
+
+	auto& head = toHead(response);
+	peq::network::ConstBuffer buffers[] = {
+		{ head.data(), head.size() },
+		{ s_headEnd, sizeof(s_headEnd) - 1 }
+	};
+	auto sent = send(buffers, 2);
+	if (sent < 0)
+	{
+		return -1;
+	}
+	if (!response.body.empty() && sendChunk(response.body.data(), response.body.size()) < 0)
+	{
+		return -1;
+	}
+	if (response.sharedBody.data && sendChunk(response.sharedBody.data, response.sharedBody.size) < 0)
+	{
+		return -1;
+	}
+	return sent;
+}
+
+int HttpSession::sendChunk(const char* data, size_t length)
+{
+	if (_chunked == Chunked::None)
+	{
+		return -1;
+	}
+	if (length > 0 && _chunked != Chunked::Head)
+	{
+		int sent = 0;
+		if (_chunked == Chunked::Raw)
+		{
+			peq::network::ConstBuffer buffer = { data, length };
+			sent = send(&buffer, 1);
+		}
+		else
+		{
+			char size[20];
+			auto sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+			peq::network::ConstBuffer buffers[] = {
+				{ size, static_cast<size_t>(sizeLength) },
+				{ data, length },
+				{ s_headEnd, sizeof(s_headEnd) - 1 }
+			};
+			sent = send(buffers, 3);
+		}
+		if (sent < 0)
+		{
+			return -1;
+		}
+	}
+	// pending output lets producer slow down, outputFull() and outputDrained() report water marks
+	return static_cast<int>(std::min<uint64_t>(pendingOutput(), std::numeric_limits<int>::max()));
+}
+
+int HttpSession::endChunked()
+{
+	if (_chunked == Chunked::None)
+	{
+		return 0;
+	}
+
+	int sent = 0;
+	if (_chunked == Chunked::Encoded)
+	{
+		const char last[] = "0\r\n\r\n";
+		sent = HttpSession::send(last, sizeof(last) - 1);
+	}
+	_chunked = Chunked::None;
 
+	// connection close of request was postponed until body was complete
+	if (!_keepAlive || _requests > _keepAlivemMaxRequests)
+	{
+		disconnect();
+	}
+	else if (!_parsing && !_pending.empty())
+	{
+		// requests received while body was streamed, handler calling endChunked continues with its own data
+		auto pending = std::move(_pending);
+		_pending.clear();
+		parse(pending.data(), pending.size());
+	}
+	return sent;
+}
 
+int HttpSession::sendRanges(http::Response& response, const std::vector<http::ByteRange>& ranges)
+{
+	// multipart/byteranges, parts are sent straight from file or shared data like single range
+	auto size = contentSize(response);
+	auto type = responseHeader(response, s_contentTypeHeader);
+	thread_local std::mt19937_64 random(std::random_device{}());
+	char boundary[24] = { 0 };
+	snprintf(boundary, sizeof(boundary), "peq%016llx", static_cast<unsigned long long>(random()));
+
+	std::vector<std::string> parts;
+	uint64_t length = 0;
+	for (auto& range : ranges)
+	{
+		std::string part = std::string("\r\n--") + boundary + "\r\n";
+		if (!type.empty())
+		{
+			part += s_contentTypeHeader + ": " + type + "\r\n";
+		}
+		part += s_contentRangeHeader + ": " + contentRange(range, size) + "\r\n\r\n";
+		length += part.size() + range.size();
+		parts.push_back(std::move(part));
+	}
+	std::string closing = std::string("\r\n--") + boundary + "--\r\n";
+	length += closing.size();
 
-	auto d = toData(response);
+	response.status = Status::PartialContent;
+	setHeader(response.headers, s_contentTypeHeader, std::string("multipart/byteranges; boundary=") + boundary);
+	setHeader(response.headers, s_contentLengthHeader, peq::string::from(length));
+	auto& head = toHead(response);
 
 	peq::log::debug("http response sent");
 
-	return Session::send(d.data(), d.size());
+	int64_t sent = 0;
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		auto& range = ranges[i];
+		peq::network::ConstBuffer buffers[4];
+		unsigned count = 0;
+		if (i == 0)
+		{
+			buffers[count++] = { head.data(), head.size() };
+			buffers[count++] = { s_headEnd, sizeof(s_headEnd) - 1 };
+		}
+		buffers[count++] = { parts[i].data(), parts[i].size() };
+
+		int64_t result = 0;
+		if (response.file.file)
+		{
+			result = Session::sendFile(buffers, count, { response.file.file, response.file.offset + range.first, range.size() });
+		}
+		else if (response.sharedBody.data)
+		{
+			result = Session::sendShared(buffers, count, { response.sharedBody.owner, response.sharedBody.data + range.first, static_cast<size_t>(range.size()) });
+		}
+		else
+		{
+			buffers[count++] = { response.body.data() + range.first, static_cast<size_t>(range.size()) };
+			result = Session::send(buffers, count);
+		}
+		if (result < 0)
+		{
+			return -1;
+		}
+		sent += result;
+	}
+	if (Session::send(closing.data(), static_cast<unsigned>(closing.size())) < 0)
+	{
+		return -1;
+	}
+	sent += closing.size();
+	return static_cast<int>(std::min<int64_t>(sent, std::numeric_limits<int>::max()));
 }
 
 int HttpSession::send(http::Response&& response)
@@ -1162,18 +2618,48 @@ void HttpSession::setKeepaliveMaxRequests(unsigned maxRequests)
 	_keepAlivemMaxRequests = maxRequests;
 }
 
+void HttpSession::setParseMode(ParseMode mode)
+{
+	_parseMode = mode;
+}
+
+void HttpSession::setMaxRequestSize(size_t bytes)
+{
+	_parseState.limit = bytes;
+}
+
+void HttpSession::setMaxReceiveBufferSize(size_t bytes)
+{
+	_maxReceiveBufferSize = std::max<size_t>(bytes, 1);
+	if (_buffer.size() > _maxReceiveBufferSize)
+	{
+		_buffer.resize(_maxReceiveBufferSize);
+		_buffer.shrink_to_fit();
+	}
+}
+
+void HttpSession::setCompression(size_t minimumSize)
+{
+	_compressionMinimumSize = minimumSize;
+}
+
 int HttpSession::handleOnHeaderField(llhttp_t* h, const char* at, size_t length)
 {
 	auto session = (HttpSession*)h->data;
-	session->_parseState.currentHeader.name += std::string(at, length);
-	return 0;
+	auto& state = session->_parseState;
+	if (state.headerComplete)
+	{
+		state.headers.emplace_back();
+		state.headerComplete = false;
+	}
+	return state.append(state.headers.back().first, at, length) ? 0 : HPE_USER;
 }
 
 int HttpSession::handleOnHeaderValue(llhttp_t* h, const char* at, size_t length)
 {
 	auto session = (HttpSession*)h->data;
-	session->_parseState.currentHeader.value += std::string(at, length);
-	return 0;
+	auto& state = session->_parseState;
+	return state.append(state.headers.back().second, at, length) ? 0 : HPE_USER;
 }
 
 int HttpSession::handleOnMessageComplete(llhttp_t* h)
@@ -1183,20 +2669,49 @@ int HttpSession::handleOnMessageComplete(llhttp_t* h)
 	session->_parseState.method = (http::Method)h->method;
 	session->_parseState.version.minor = h->http_minor;
 	session->_parseState.version.major = h->http_major;
-	return 0;
+	// request is handled before parser continues to next pipelined request
+	return HPE_PAUSED;
 }
 
 int HttpSession::handleOnHeadersComplete(llhttp_t* h)
 {
 	auto session = (HttpSession*)h->data;
+	auto& state = session->_parseState;
+	if (session->_parseMode == ParseMode::Request)
+	{
+		session->makeRequest();
+		session->_bodyStream = session->httpBodyStream(session->_currentRequest);
+		if (session->_bodyStream)
+		{
+			return 0;
+		}
+	}
+	if (h->flags & F_CONTENT_LENGTH)
+	{
+		// whole body is known, reject early and reserve its first reads. Rest grows as data arrives,
+		// so a large Content-Length alone does not allocate
+		if (state.arena.size() > state.limit || h->content_length > state.limit - state.arena.size())
+		{
+			state.tooLarge = true;
+			return -1;
+		}
+		auto reserve = static_cast<size_t>(std::min<uint64_t>(h->content_length, session->_maxReceiveBufferSize));
+		if (session->_parseMode == ParseMode::Request)
+		{
+			session->_currentRequest.body.reserve(reserve);
+		}
+		else
+		{
+			state.arena.reserve(state.arena.size() + reserve);
+		}
+	}
 	return 0;
 }
 
 int HttpSession::handleOnHeaderValueComplete(llhttp_t* h)
 {
 	auto session = (HttpSession*)h->data;
-	session->_parseState.headers.push_back(session->_parseState.currentHeader);
-	session->_parseState.currentHeader = http::Header();
+	session->_parseState.headerComplete = true;
 	return 0;
 }
 
@@ -1208,17 +2723,76 @@ int HttpSession::handleOnHeaderFieldComplete(llhttp_t* h)
 int HttpSession::handleOnBody(llhttp_t* h, const char* at, size_t length)
 {
 	auto session = (HttpSession*)h->data;
-	if (session->_parseState.bodyStart == nullptr)
+	if (session->_bodyStream)
+	{
+		if (!session->_bodyStream->write(at, length))
+		{
+			session->_parseState.streamAborted = true;
+			return HPE_USER;
+		}
+		return 0;
+	}
+	auto& state = session->_parseState;
+	if (session->_parseMode == ParseMode::View)
+	{
+		return state.append(state.body, at, length) ? 0 : HPE_USER;
+	}
+	// request body is not kept in arena, copying it out later would copy every byte twice
+	auto& body = session->_currentRequest.body;
+	if (state.arena.size() + body.size() + length > state.limit)
+	{
+		state.tooLarge = true;
+		return HPE_USER;
+	}
+	if ((h->flags & F_CONTENT_LENGTH) && body.size() + length > body.capacity())
 	{
-		session->_parseState.bodyStart = at;
+		// body has started arriving beyond first reads, parser counts down the rest of validated Content-Length
+		body.reserve(body.size() + length + static_cast<size_t>(h->content_length));
 	}
-	session->_parseState.bodyLength += length;
+	body.insert(body.end(), at, at + length);
 	return 0;
 }
 
 int HttpSession::handleOnUrl(llhttp_t* h, const char* at, size_t length)
 {
 	auto session = (HttpSession*)h->data;
-	session->_parseState.url = Url(std::string(at, length));
-	return 0;
+	return session->_parseState.append(session->_parseState.url, at, length) ? 0 : HPE_USER;
+}
+
+bool ParseState::append(ArenaSpan& span, const char* at, size_t length)
+{
+	if (arena.size() + length > limit)
+	{
+		tooLarge = true;
+		return false;
+	}
+	if (span.length == 0)
+	{
+		span.offset = arena.size();
+	}
+	arena.insert(arena.end(), at, at + length);
+	span.length += length;
+	return true;
+}
+
+std::string_view ParseState::view(const ArenaSpan& span) const
+{
+	return std::string_view(arena.data() + span.offset, span.length);
+}
+
+void ParseState::reset()
+{
+	if (arena.capacity() > keptArenaCapacity)
+	{
+		// memory of large upload is not held by idle connection
+		std::vector<char>().swap(arena);
+	}
+	arena.clear();
+	headers.clear();
+	url = ArenaSpan();
+	body = ArenaSpan();
+	headerComplete = true;
+	tooLarge = false;
+	streamAborted = false;
+	complete = false;
 }
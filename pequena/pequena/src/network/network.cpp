@@ -1,5 +1,6 @@
 #include "pequena/network/network.h"
 #include "pequena/log.h"
+#include "pequena/time.h"
 #include <assert.h>
 #include <deque>
 #include <mutex>
@@ -8,6 +9,8 @@
 #include <iostream>
 #include <sstream>
 #include <filesystem>
+#include <chrono>
+#include <algorithm>
 
 using namespace peq;
 using namespace peq::network;
@@ -44,9 +47,82 @@ SessionFilterRef SessionFilter::createTLS(SessionFilter::Mode mode, SertificateC
 	return createFilterTLS(mode, sertificates);
 }
 
-ServerSocketRef ServerSocket::create(int port, SocketMode mode)
+int ClientSocket::send(const ConstBuffer* buffers, unsigned count)
 {
-	return createServerSocket(port, mode);
+	int sent = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (buffers[i].size == 0) continue;
+		auto result = send(buffers[i].data, static_cast<unsigned>(buffers[i].size));
+		if (result < 0)
+		{
+			return sent > 0 ? sent : -1;
+		}
+		sent += result;
+		if (static_cast<size_t>(result) < buffers[i].size)
+		{
+			break;
+		}
+	}
+	return sent;
+}
+
+int64_t ClientSocket::sendFile(const File& file, uint64_t offset, uint64_t size)
+{
+	// backend without zero-copy support, read file in chunks and send until socket is full
+	char buffer[16 * 1024];
+	int64_t sent = 0;
+	while (static_cast<uint64_t>(sent) < size)
+	{
+		auto chunk = std::min<uint64_t>(size - sent, sizeof(buffer));
+		auto read = file.read(buffer, static_cast<size_t>(chunk), offset + sent);
+		if (read <= 0)
+		{
+			peq::log::error("failed to read file for sending");
+			return sent > 0 ? sent : -1;
+		}
+		auto result = send(buffer, static_cast<unsigned>(read));
+		if (result < 0)
+		{
+			return sent > 0 ? sent : -1;
+		}
+		sent += result;
+		if (result < read)
+		{
+			break;
+		}
+	}
+	return sent;
+}
+
+FileRef File::open(const std::string& path)
+{
+	return createFile(path);
+}
+
+SharedData File::map(const FileRef& file)
+{
+	return file ? mapFile(file) : SharedData();
+}
+
+ServerSocketRef ServerSocket::create(int port, SocketMode mode, bool reusePort)
+{
+	return createServerSocket(port, mode, reusePort);
+}
+
+unsigned ServerSocket::accept(std::vector<ClientSocketRef>& sockets, unsigned max)
+{
+	// backend may use blocking socket, so only single accept is safe here
+	if (max == 0)
+	{
+		return 0;
+	}
+	if (auto socket = accept())
+	{
+		sockets.push_back(socket);
+		return 1;
+	}
+	return 0;
 }
 
 SocketSelectorRef SocketSelector::create() {
@@ -67,15 +143,227 @@ int Session::receive(char* data, unsigned dataLength)
 
 int Session::send(const char* data, unsigned dataLength)
 {
-	std::lock_guard<std::mutex> lock(m_sendMutex);
-	if (_filter)
+	int result = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_sendMutex);
+		if (_filter)
+		{
+			ConstBuffer buffer = { data, dataLength };
+			auto sent = filterSend(&buffer, 1, Output());
+			result = sent < 0 ? -1 : static_cast<int>(sent);
+		}
+		else
+		{
+			result = socketSend(data, dataLength);
+		}
+	}
+	notifyOutputFull();
+	return result;
+}
+
+int Session::send(const ConstBuffer* buffers, unsigned count)
+{
+	int result = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_sendMutex);
+		if (_filter)
+		{
+			auto sent = filterSend(buffers, count, Output());
+			result = sent < 0 ? -1 : static_cast<int>(sent);
+		}
+		else
+		{
+			result = socketSend(buffers, count);
+		}
+	}
+	notifyOutputFull();
+	return result;
+}
+
+int64_t Session::sendFile(const ConstBuffer* buffers, unsigned count, const FileRange& file)
+{
+	Output tail;
+	tail.file = file;
+	int64_t result = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_sendMutex);
+		// secure file has to be encrypted, it is queued and read in chunks by flush()
+		result = _filter ? filterSend(buffers, count, tail) : socketSend(buffers, count, tail);
+	}
+	notifyOutputFull();
+	return result;
+}
+
+int64_t Session::sendShared(const ConstBuffer* buffers, unsigned count, const SharedData& data)
+{
+	Output tail;
+	tail.shared = data;
+	int64_t result = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_sendMutex);
+		// secure shared data is encrypted in chunks by flush() instead of copying all of it to output
+		result = _filter ? filterSend(buffers, count, tail) : socketSend(buffers, count, tail);
+	}
+	notifyOutputFull();
+	return result;
+}
+
+void Session::notifyOutputFull()
+{
+	// handler may send from outputFull(), so it is called only after send mutex is released
+	bool full = false;
+	{
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		full = _outputFullPending;
+		_outputFullPending = false;
+	}
+	if (full)
+	{
+		outputFull();
+	}
+}
+
+int64_t Session::filterSend(const ConstBuffer* buffers, unsigned count, const Output& tail)
+{
+	bool queue = false;
+	{
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		if (_socket->isDisconnected())
+		{
+			return -1;
+		}
+		// records encrypted now would overtake queued plaintext, so it is queued too
+		queue = !_output.empty() && _output.back().plain;
+	}
+
+	int64_t sent = 0;
+	if (queue)
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			sent += buffers[i].size;
+		}
+		queuePlain(buffers, count, tail);
+	}
+	else
+	{
+		// filter encrypts buffers one by one
+		for (unsigned i = 0; i < count; i++)
+		{
+			if (buffers[i].size == 0) continue;
+			auto result = _filter->send(buffers[i].data, static_cast<unsigned>(buffers[i].size));
+			if (result == 0)
+			{
+				return -1;
+			}
+			sent += result;
+		}
+		if (tail.size() > 0)
+		{
+			queuePlain(nullptr, 0, tail);
+		}
+	}
+	return sent + static_cast<int64_t>(tail.size());
+}
+
+int Session::filterOutput(const char* data, unsigned dataLength)
+{
+	// records of queued plaintext are collected by flush() instead of being sent behind it
+	if (_encrypted)
+	{
+		_encrypted->insert(_encrypted->end(), data, data + dataLength);
+		return static_cast<int>(dataLength);
+	}
+	return socketSend(data, dataLength);
+}
+
+void Session::queuePlain(const ConstBuffer* buffers, unsigned count, const Output& tail)
+{
+	std::lock_guard<std::mutex> lock(_outputMutex);
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (buffers[i].size == 0) continue;
+		Output output;
+		output.data.assign(buffers[i].data, buffers[i].data + buffers[i].size);
+		output.plain = true;
+		_output.push_back(std::move(output));
+		_outputSize += buffers[i].size;
+	}
+	if (tail.size() > 0)
 	{
-		return _filter->send(data, dataLength);
+		Output output;
+		output.shared = tail.shared;
+		output.file = tail.file;
+		output.plain = true;
+		_output.push_back(std::move(output));
+		_outputSize += tail.size();
+	}
+	if (!_corked)
+	{
+		setWriteInterest(true);
+	}
+	if (!_outputFull && _outputSize >= _highWaterMark)
+	{
+		_outputFull = _outputFullPending = true;
+	}
+}
+
+bool Session::encryptOutput()
+{
+	// plaintext entries are never partially sent, so output offset is zero here
+	auto& front = _output.front();
+	size_t length = 0;
+	unsigned result = 0;
+	Data encrypted;
+	_encrypted = &encrypted;
+	if (front.file.file)
+	{
+		char chunk[fileChunkSize];
+		length = static_cast<size_t>(std::min<uint64_t>(front.file.size, fileChunkSize));
+		auto read = front.file.file->read(chunk, length, front.file.offset);
+		if (read == static_cast<int64_t>(length))
+		{
+			result = _filter->send(chunk, static_cast<unsigned>(length));
+		}
+		else
+		{
+			peq::log::error("failed to read file for sending");
+		}
+		front.file.offset += length;
+		front.file.size -= length;
+	}
+	else if (front.shared.data)
+	{
+		length = std::min(front.shared.size, fileChunkSize);
+		result = _filter->send(front.shared.data, static_cast<unsigned>(length));
+		front.shared.data += length;
+		front.shared.size -= length;
 	}
 	else
 	{
-		return socketSend(data, dataLength);
+		length = front.data.size();
+		result = _filter->send(front.data.data(), static_cast<unsigned>(length));
+		front.data.clear();
+	}
+	_encrypted = nullptr;
+	if (result == 0)
+	{
+		return false;
+	}
+
+	_outputSize -= length;
+	if (front.size() == 0)
+	{
+		_output.pop_front();
+	}
+	if (!encrypted.empty())
+	{
+		_outputSize += encrypted.size();
+		Output output;
+		output.data = std::move(encrypted);
+		_output.push_front(std::move(output));
 	}
+	return true;
 }
 
 void Session::doHandle()
@@ -99,32 +387,336 @@ int Session::socketReceive(char* data, unsigned dataLength)
 	return _socket->receive(data, dataLength);
 }
 
-
 int Session::socketSend(const char* data, unsigned dataLength)
 {
-	return _socket->send(data, dataLength);
+	ConstBuffer buffer = { data, dataLength };
+	return socketSend(&buffer, 1);
+}
+
+int Session::socketSend(const ConstBuffer* buffers, unsigned count)
+{
+	auto result = socketSend(buffers, count, Output());
+	return result < 0 ? -1 : static_cast<int>(result);
+}
+
+int64_t Session::socketSend(const ConstBuffer* buffers, unsigned count, const Output& tail)
+{
+	size_t total = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		total += buffers[i].size;
+	}
+	const auto& file = tail.file;
+	uint64_t fileSent = 0;
+	auto fileSize = file.file ? file.size : 0;
+	size_t sharedSent = 0;
+	auto sharedSize = tail.shared.data ? tail.shared.size : 0;
+
+	{
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		if (_socket->isDisconnected())
+		{
+			return -1;
+		}
+
+		size_t sent = 0;
+		if (_output.empty() && !_corked)
+		{
+			int result = 0;
+			if (sharedSize > 0 && count < flushBuffers)
+			{
+				// shared data goes out with the same gathered write
+				ConstBuffer all[flushBuffers];
+				std::copy(buffers, buffers + count, all);
+				all[count] = { tail.shared.data, sharedSize };
+				result = _socket->send(all, count + 1);
+				if (result >= 0 && static_cast<size_t>(result) > total)
+				{
+					sharedSent = static_cast<size_t>(result) - total;
+					result = static_cast<int>(total);
+				}
+			}
+			else
+			{
+				result = _socket->send(buffers, count);
+				if (result >= 0 && static_cast<size_t>(result) == total && sharedSize > 0)
+				{
+					auto sharedResult = _socket->send(tail.shared.data, static_cast<unsigned>(sharedSize));
+					if (sharedResult < 0)
+					{
+						return -1;
+					}
+					sharedSent = static_cast<size_t>(sharedResult);
+				}
+			}
+			if (result < 0)
+			{
+				return -1;
+			}
+			sent = static_cast<size_t>(result);
+
+			if (sent == total && sharedSent == sharedSize && fileSize > 0)
+			{
+				auto fileResult = _socket->sendFile(*file.file, file.offset, fileSize);
+				if (fileResult < 0)
+				{
+					return -1;
+				}
+				fileSent = static_cast<uint64_t>(fileResult);
+			}
+		}
+
+		if (sent < total || sharedSent < sharedSize || fileSent < fileSize)
+		{
+			// socket buffer is full or session is corked, keep rest and send it when selector reports socket writable or on uncork
+			if (!_corked)
+			{
+				setWriteInterest(true);
+			}
+			for (unsigned i = 0; i < count; i++)
+			{
+				if (sent >= buffers[i].size)
+				{
+					sent -= buffers[i].size;
+					continue;
+				}
+				Output output;
+				output.data.assign(buffers[i].data + sent, buffers[i].data + buffers[i].size);
+				_output.push_back(std::move(output));
+				_outputSize += buffers[i].size - sent;
+				sent = 0;
+			}
+			if (sharedSent < sharedSize)
+			{
+				// reference is kept, shared data is not copied
+				Output output;
+				output.shared = { tail.shared.owner, tail.shared.data + sharedSent, sharedSize - sharedSent };
+				_output.push_back(std::move(output));
+				_outputSize += sharedSize - sharedSent;
+			}
+			if (fileSent < fileSize)
+			{
+				// file stays on disk until socket can take it
+				Output output;
+				output.file = { file.file, file.offset + fileSent, fileSize - fileSent };
+				_output.push_back(std::move(output));
+				_outputSize += fileSize - fileSent;
+			}
+			if (!_outputFull && _outputSize >= _highWaterMark)
+			{
+				// reported by notifyOutputFull() after send mutex is released
+				_outputFull = _outputFullPending = true;
+			}
+		}
+	}
+	return static_cast<int64_t>(total + sharedSize + fileSize);
+}
+
+void Session::flush()
+{
+	bool drained = false;
+	bool close = false;
+	bool failed = false;
+	{
+		// secure session encrypts queued plaintext here, filter is used by senders under send mutex
+		std::unique_lock<std::mutex> sendLock(m_sendMutex, std::defer_lock);
+		if (_filter)
+		{
+			sendLock.lock();
+		}
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		if (_output.empty())
+		{
+			return;
+		}
+
+		ConstBuffer buffers[flushBuffers];
+		while (!_output.empty())
+		{
+			auto& front = _output.front();
+			if (front.plain)
+			{
+				if (!encryptOutput())
+				{
+					failed = true;
+					break;
+				}
+				continue;
+			}
+			if (front.file.file)
+			{
+				// backends fail when file is shorter than range, so zero means socket is full
+				auto result = _socket->sendFile(*front.file.file, front.file.offset + _outputOffset, front.file.size - _outputOffset);
+				if (result < 0)
+				{
+					failed = true;
+					break;
+				}
+				_outputSize -= result;
+				_outputOffset += result;
+				if (_outputOffset < front.file.size)
+				{
+					break;
+				}
+				_output.pop_front();
+				_outputOffset = 0;
+				continue;
+			}
+
+			// gather memory chunks up to next file range
+			unsigned count = 0;
+			size_t total = 0;
+			for (auto it = _output.begin(); it != _output.end() && !it->file.file && !it->plain && count < flushBuffers; ++it, ++count)
+			{
+				auto offset = count == 0 ? _outputOffset : 0;
+				auto view = it->view();
+				buffers[count] = { view.data + offset, static_cast<size_t>(view.size - offset) };
+				total += buffers[count].size;
+			}
+
+			auto result = _socket->send(buffers, count);
+			if (result < 0)
+			{
+				failed = true;
+				break;
+			}
+
+			auto written = static_cast<uint64_t>(result);
+			_outputSize -= written;
+			written += _outputOffset;
+			while (!_output.empty() && written >= _output.front().size())
+			{
+				written -= _output.front().size();
+				_output.pop_front();
+			}
+			_outputOffset = written;
+
+			if (static_cast<size_t>(result) < total)
+			{
+				break;
+			}
+		}
+
+		if (failed)
+		{
+			// output can not be sent anymore, nothing is left to keep write interest or session open
+			_output.clear();
+			_outputOffset = 0;
+			_outputSize = 0;
+		}
+		setWriteInterest(!_output.empty());
+		if (_outputFull && _outputSize <= _lowWaterMark)
+		{
+			// drain is not reported when session has not yet been told output was full
+			_outputFull = false;
+			drained = !_outputFullPending;
+			_outputFullPending = false;
+		}
+		close = failed || (_closing && _output.empty());
+	}
+
+	if (close)
+	{
+		_socket->disconnect();
+	}
+	else if (drained)
+	{
+		outputDrained();
+	}
+}
+
+void Session::setWriteInterest(bool enabled)
+{
+	// selector is told only about changes
+	if (_selector && _writeInterest != enabled)
+	{
+		_selector->setWriteInterest(_socket, enabled);
+		_writeInterest = enabled;
+	}
+}
+
+void Session::cork()
+{
+	std::lock_guard<std::mutex> lock(_outputMutex);
+	_corked = true;
+}
+
+void Session::uncork()
+{
+	{
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		_corked = false;
+	}
+	flush();
+}
+
+uint64_t Session::pendingOutput() const
+{
+	std::lock_guard<std::mutex> lock(_outputMutex);
+	return _outputSize;
+}
+
+void Session::setOutputLimits(size_t highWaterMark, size_t lowWaterMark)
+{
+	std::lock_guard<std::mutex> lock(_outputMutex);
+	_highWaterMark = highWaterMark;
+	_lowWaterMark = std::min(lowWaterMark, highWaterMark);
 }
 
 void Session::disconnect()
 {
+	{
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		if (!_output.empty())
+		{
+			// socket is closed by flush() when output has been sent or by doUpdate() after timeout
+			_closing = true;
+			_closeDeadline = peq::time::epochMs() + closeTimeoutMs;
+			return;
+		}
+	}
 	_socket->disconnect();
 }
 
+void Session::doUpdate()
+{
+	update();
+
+	bool timeout = false;
+	{
+		std::lock_guard<std::mutex> lock(_outputMutex);
+		timeout = _closing && peq::time::epochMs() > _closeDeadline;
+	}
+	if (timeout)
+	{
+		peq::log::debug("disconnect session (pending output timeout)");
+		_socket->disconnect();
+	}
+}
+
 void Session::bindFilter(SessionFilterRef filter)
 {
 	_filter = filter;
-	filter->sendFunc = std::bind(&Session::socketSend, this, std::placeholders::_1, std::placeholders::_2);
+	filter->sendFunc = std::bind(&Session::filterOutput, this, std::placeholders::_1, std::placeholders::_2);
 	filter->recvFunc = std::bind(&Session::socketReceive, this, std::placeholders::_1, std::placeholders::_2);
 }
 
-Server::ConnectionTask::ConnectionTask() : _abort(false)
+Server::ConnectionTask::ConnectionTask(Server* server) : _server(server), _connections(0), _utilization(0), _abort(false)
 {
-	
+	// Selector is created here and not in awake(), Server may add sockets before the task thread has started
+	_selector = createSocketSelector(server->_ioBackend);
+
+	// Runner creates all tasks before starting threads, so listen sockets can be assigned without locking
+	if (server->_reusePort)
+	{
+		_listenSocket = _selector->attach(server->_listenSockets.back());
+		server->_listenSockets.pop_back();
+		_selector->add(_listenSocket);
+	}
 }
 
 void Server::ConnectionTask::awake()
 {
-	_selector = createSocketSelector();
 }
 
 void Server::ConnectionTask::abort()
@@ -142,19 +734,25 @@ void Server::ConnectionTask::execute()
 	std::vector<ClientSocketRef> sockets;
 	std::map<unsigned, SessionRef> handlers;
 	std::vector<ClientSocketRef> dcSockets;
+	std::vector<ClientSocketRef> accepted;
+	auto windowStart = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration busy(0);
 
 	while (!_abort)
 	{
 		{
 			std::unique_lock<std::mutex> lock(_mutex);
 			_condition.wait(lock, [this, &sockets]() {
-				return !sockets.empty() || _abort || !_newSockets.empty();
+				return !sockets.empty() || _abort || !_newSockets.empty() || _listenSocket;
 			});
 
 			for (auto it : _newSockets) {
+				it.socket = _selector->attach(it.socket);
+				it.handler->_socket = it.socket;
 				sockets.push_back(it.socket);
 				_selector->add(it.socket);
 				handlers[it.socket->id()] = it.handler;
+				it.handler->_selector = _selector;
 				it.handler->connected();
 
 			}
@@ -162,11 +760,32 @@ void Server::ConnectionTask::execute()
 		}
 
 		auto readSockets = _selector->wait(1000);
+		auto busyStart = std::chrono::steady_clock::now();
 
 		for (auto it : readSockets) {
+			if (it == _listenSocket)
+			{
+				// accept directly to this thread, no hand-off through add()
+				_server->accepted(_listenSocket->accept(accepted, acceptBatchSize));
+				_connections.fetch_add(static_cast<unsigned>(accepted.size()));
+				for (auto clientSocket : accepted)
+				{
+					clientSocket = _selector->attach(clientSocket);
+					auto session = _server->createSession(clientSocket);
+					sockets.push_back(clientSocket);
+					_selector->add(clientSocket);
+					handlers[clientSocket->id()] = session;
+					session->_selector = _selector;
+					session->connected();
+				}
+				// sockets are owned by sessions, closed connections must not be kept open here
+				accepted.clear();
+				continue;
+			}
 			auto handler = handlers.find(it->id());
 			if (handler != handlers.end())
 			{
+				handler->second->flush();
 				handler->second->doHandle();
 			}
 		}
@@ -174,7 +793,7 @@ void Server::ConnectionTask::execute()
 		for (auto it : sockets)
 		{
 			auto handler = handlers.find(it->id());
-			handler->second->update();
+			handler->second->doUpdate();
 
 			if (it->isDisconnected())
 			{
@@ -194,14 +813,30 @@ void Server::ConnectionTask::execute()
 			_selector->remove(it);
 			sockets.erase(std::remove(sockets.begin(), sockets.end(), it));
 			handlers.erase(it->id());
+			_connections.fetch_sub(1);
 		}
 
 		dcSockets.clear();
+
+		auto now = std::chrono::steady_clock::now();
+		busy += now - busyStart;
+		if (now - windowStart >= std::chrono::seconds(1))
+		{
+			auto permille = busy * 1000 / (now - windowStart);
+			_utilization.store(static_cast<unsigned>(std::min<decltype(permille)>(permille, 1000)));
+			busy = std::chrono::steady_clock::duration(0);
+			windowStart = now;
+		}
 	}
 }
 
 void Server::ConnectionTask::destroy()
 {
+	if (_listenSocket)
+	{
+		_selector->remove(_listenSocket);
+		_listenSocket = nullptr;
+	}
 }
 
 void Server::ConnectionTask::add(ClientSocketRef socket,  SessionRef handler)
@@ -213,10 +848,32 @@ void Server::ConnectionTask::add(ClientSocketRef socket,  SessionRef handler)
 		ns.socket = socket;
 		_newSockets.push_back(ns);
 	}
+	_connections.fetch_add(1);
 	_selector->wakeUp();
 	_condition.notify_one();
 }
 
+void Server::ConnectionTask::add(std::vector<NewSocket>& sockets)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_newSockets.insert(_newSockets.end(), sockets.begin(), sockets.end());
+	}
+	_connections.fetch_add(static_cast<unsigned>(sockets.size()));
+	_selector->wakeUp();
+	_condition.notify_one();
+}
+
+unsigned Server::ConnectionTask::connections() const
+{
+	return _connections.load();
+}
+
+unsigned Server::ConnectionTask::utilization() const
+{
+	return _utilization.load();
+}
+
 Server& Server::setThreads(unsigned threads)
 {
 	_threads = threads;
@@ -229,6 +886,24 @@ Server& Server::setPort(unsigned port)
 	return *this;
 }
 
+Server& Server::setIOBackend(IOBackend backend)
+{
+	_ioBackend = backend;
+	return *this;
+}
+
+Server& Server::setReusePort(bool enabled)
+{
+	_reusePort = enabled;
+	return *this;
+}
+
+Server& Server::setDistribution(Distribution distribution)
+{
+	_distribution = distribution;
+	return *this;
+}
+
 Server& Server::setTLS(const std::string& crt, const std::string &key)
 {
 	if (!std::filesystem::exists(crt) || !std::filesystem::exists(key))
@@ -277,28 +952,90 @@ Server& Server::setTLS(const std::string& pem)
 	return *this;
 }
 
-Server::Server() : _threads(1), _port(80), _tls(false)
+Server::Server() : _threads(1), _port(80), _ioBackend(IOBackend::Default), _reusePort(false), _distribution(Distribution::RoundRobin), _roundRobin(0), _random(std::random_device()()), _tls(false)
 {
 	_stop.store(false);
+	_acceptWakeups.store(0);
+	_accepted.store(0);
+	_largestAcceptBatch.store(0);
+}
+
+SessionRef Server::createSession(ClientSocketRef socket)
+{
+	auto session = _sessionProvider->get();
+	if (_tls)
+	{
+		if (auto filter = SessionFilter::createTLS(SessionFilter::Mode::Server, _sertificates)) {
+			session->bindFilter(filter);
+		}
+	}
+	session->_socket = socket;
+	return session;
 }
 
 void Server::start()
 {
+	if (_reusePort)
+	{
+		for (unsigned i = 0; i < _threads; i++)
+		{
+			auto listenSocket = ServerSocket::create(_port, SocketMode::NonBlocking, true);
+			if (!listenSocket)
+			{
+				_listenSockets.clear();
+				break;
+			}
+			_listenSockets.push_back(listenSocket);
+		}
 
-	auto listenSocket = ServerSocket::create(_port, SocketMode::NonBlocking);
-	if (!listenSocket) {
-		peq::log::error("Could not bind server to port: " + std::to_string(_port));
-		return;
+		if (_listenSockets.empty())
+		{
+			peq::log::warning("Could not bind reuseport sockets to port: " + std::to_string(_port) + ", using single acceptor");
+			_reusePort = false;
+		}
 	}
 
-	bool tls = _tls;
+	ServerSocketRef listenSocket;
+	if (!_reusePort)
+	{
+		listenSocket = ServerSocket::create(_port, SocketMode::NonBlocking);
+		if (!listenSocket) {
+			peq::log::error("Could not bind server to port: " + std::to_string(_port));
+			return;
+		}
+	}
 
 	_runner
 		.setThreads(_threads)
-		.start();
+		.start(this);
 
-	int currentPool = 0;
-	peq::network::SocketSelectorRef selector = peq::network::createSocketSelector();
+	if (listenSocket)
+	{
+		acceptLoop(listenSocket);
+	}
+	else
+	{
+		// tasks accept connections by themselves
+		while (!_stop.load())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	for (unsigned i = 0; i < _threads; i++)
+	{
+		_runner.get(i)->abort();
+	}
+	_runner.wait();
+}
+
+void Server::acceptLoop(ServerSocketRef listenSocket)
+{
+	std::vector<ClientSocketRef> clientSockets;
+	std::vector<std::vector<ConnectionTask::NewSocket>> batches(_threads);
+	std::vector<unsigned> pending(_threads, 0);
+	peq::network::SocketSelectorRef selector = peq::network::createSocketSelector(_ioBackend);
+	listenSocket = selector->attach(listenSocket);
 	selector->add(listenSocket);
 	while (!_stop.load())
 	{
@@ -306,29 +1043,97 @@ void Server::start()
 		if (results.empty()) {
 			continue;
 		}
-		auto clientSocket = std::dynamic_pointer_cast<peq::network::ServerSocket>(results.front())->accept();
-		if (clientSocket)
+
+		// drain listen queue and hand sockets to tasks in one batch per task
+		accepted(listenSocket->accept(clientSockets, acceptBatchSize));
+		for (auto clientSocket : clientSockets)
 		{
-			peq::log::debug("Accepted connection");
-			auto session = _sessionProvider->get();
-			if (tls)
+			auto task = nextTask(pending);
+			pending[task]++;
+			batches[task].push_back({ clientSocket, createSession(clientSocket) });
+		}
+		for (unsigned i = 0; i < _threads; i++)
+		{
+			if (!batches[i].empty())
 			{
-				if (auto filter = SessionFilter::createTLS(SessionFilter::Mode::Server, _sertificates)) {
-					session->bindFilter(filter);
-				}
+				_runner.get(i)->add(batches[i]);
+				batches[i].clear();
+				pending[i] = 0;
 			}
-			session->_socket = clientSocket;
-			currentPool = (currentPool + 1) % _threads;
-			auto task = _runner.get(currentPool);
-			task->add(clientSocket, session);
 		}
+		clientSockets.clear();
 	}
+}
 
-	for (unsigned i = 0; i < _threads; i++)
+unsigned Server::nextTask(const std::vector<unsigned>& pending)
+{
+	// pending contains sockets assigned during current batch, not yet counted by tasks
+	auto less = [this, &pending](unsigned a, unsigned b) -> bool {
+		auto ta = _runner.get(a);
+		auto tb = _runner.get(b);
+		auto ca = ta->connections() + pending[a];
+		auto cb = tb->connections() + pending[b];
+		if (ca != cb)
+		{
+			return ca < cb;
+		}
+		return ta->utilization() < tb->utilization();
+	};
+
+	switch (_distribution)
 	{
-		_runner.get(i)->abort();
+	case Distribution::LeastConnections:
+	{
+		unsigned best = 0;
+		for (unsigned i = 1; i < _threads; i++)
+		{
+			if (less(i, best))
+			{
+				best = i;
+			}
+		}
+		return best;
 	}
-	_runner.wait();
+	case Distribution::PowerOfTwoChoices:
+	{
+		if (_threads < 2)
+		{
+			return 0;
+		}
+		unsigned a = _random() % _threads;
+		unsigned b = _random() % (_threads - 1);
+		if (b >= a)
+		{
+			b++;
+		}
+		return less(b, a) ? b : a;
+	}
+	case Distribution::RoundRobin:
+	default:
+		_roundRobin = (_roundRobin + 1) % _threads;
+		return _roundRobin;
+	}
+}
+
+void Server::accepted(unsigned count)
+{
+	_acceptWakeups.fetch_add(1);
+	_accepted.fetch_add(count);
+	auto largest = _largestAcceptBatch.load();
+	while (count > largest && !_largestAcceptBatch.compare_exchange_weak(largest, count)) {}
+	if (count > 0)
+	{
+		peq::log::debug("Accepted " + std::to_string(count) + " connections");
+	}
+}
+
+AcceptStats Server::acceptStats() const
+{
+	AcceptStats stats;
+	stats.wakeups = _acceptWakeups.load();
+	stats.accepted = _accepted.load();
+	stats.largestBatch = _largestAcceptBatch.load();
+	return stats;
 }
 
 void Server::stop()
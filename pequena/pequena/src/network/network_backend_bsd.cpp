@@ -1,34 +1,913 @@
 #include "pequena/network/network.h"
+#include "pequena/log.h"
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <linux/if_packet.h>
+#else
+#include <net/if_dl.h>
+#endif
 
 using namespace peq;
 using namespace peq::network;
 
+#if defined(__linux__)
+namespace peq
+{
+	namespace network
+	{
+		SocketSelectorRef createURINGSelector(); // network_backend_uring.cpp
+		ClientSocketRef createClientSocket(int socket);
+	}
+}
+#endif
+
+namespace
+{
+#if defined(__linux__)
+	constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+	constexpr int sendFlags = 0;
+#endif
+
+	bool setNonBlocking(int fd, bool nonBlocking)
+	{
+		auto flags = fcntl(fd, F_GETFL, 0);
+		if (flags == -1)
+		{
+			return false;
+		}
+		flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+		return fcntl(fd, F_SETFL, flags) == 0;
+	}
+
+	std::string errorString()
+	{
+		return std::string(strerror(errno));
+	}
+}
+
+class BSDFile : public File
+{
+public:
+	BSDFile(int fd, uint64_t size, uint64_t modified) : _fd(fd), _size(size), _modified(modified)
+	{
+	}
+	~BSDFile()
+	{
+		::close(_fd);
+	}
+	uint64_t size() const override
+	{
+		return _size;
+	}
+	uint64_t modified() const override
+	{
+		return _modified;
+	}
+	int64_t read(char* data, size_t dataLength, uint64_t offset) const override
+	{
+		ssize_t result;
+		do
+		{
+			result = ::pread(_fd, data, dataLength, static_cast<off_t>(offset));
+		} while (result == -1 && errno == EINTR);
+		return static_cast<int64_t>(result);
+	}
+	int fd() const
+	{
+		return _fd;
+	}
+private:
+	int _fd;
+	uint64_t _size;
+	uint64_t _modified;
+};
+
+class BSDClientSocket : public ClientSocket
+{
+public:
+	BSDClientSocket(int socket, SocketMode mode) : _socket(socket), _mode(mode), _disconnected(false)
+	{
+		_id = static_cast<unsigned>(_socket);
+	}
+	~BSDClientSocket()
+	{
+		disconnect();
+		// Descriptor is closed only when socket is destroyed, so the id (fd) can not be
+		// reused by a new connection while ConnectionTask still holds this socket.
+		::close(_socket);
+	}
+
+	void disconnect() override
+	{
+		if (!_disconnected)
+		{
+			::shutdown(_socket, SHUT_RDWR);
+			_disconnected = true;
+		}
+	}
+	bool isDisconnected() const override
+	{
+		return _disconnected;
+	}
+	unsigned id() const override
+	{
+		return _id;
+	}
+	int receive(char* data, unsigned dataLength) override
+	{
+		if (_disconnected)
+		{
+			return -1;
+		}
+		ssize_t result;
+		do
+		{
+			result = ::recv(_socket, data, dataLength, 0);
+		} while (result == -1 && errno == EINTR);
+
+		if (result == -1)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				disconnect();
+			}
+			return -1;
+		}
+		if (result == 0)
+		{
+			disconnect();
+		}
+		return static_cast<int>(result);
+	}
+	int send(const char* data, unsigned dataLength) override
+	{
+		if (_disconnected)
+		{
+			return -1;
+		}
+		int sent = 0;
+		int left = dataLength;
+		while (left > 0)
+		{
+			auto result = ::send(_socket, data + sent, left, sendFlags);
+			if (result > 0)
+			{
+				left -= static_cast<int>(result);
+				sent += static_cast<int>(result);
+				continue;
+			}
+			if (result == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				// socket buffer is full, Session keeps the rest until selector reports socket writable
+				break;
+			}
+			disconnect();
+			return -1;
+		}
+		return sent;
+	}
+	int send(const ConstBuffer* buffers, unsigned count) override
+	{
+		if (_disconnected)
+		{
+			return -1;
+		}
+		iovec vectors[maxVectors];
+		size_t sent = 0;
+		while (count > 0)
+		{
+			// writes buffers with sendmsg (writev + MSG_NOSIGNAL) without joining them first
+			unsigned batch = std::min(count, maxVectors);
+			size_t total = 0;
+			for (unsigned i = 0; i < batch; i++)
+			{
+				vectors[i].iov_base = const_cast<char*>(buffers[i].data);
+				vectors[i].iov_len = buffers[i].size;
+				total += buffers[i].size;
+			}
+
+			msghdr message;
+			memset(&message, 0, sizeof(message));
+			message.msg_iov = vectors;
+			message.msg_iovlen = batch;
+
+			ssize_t result;
+			do
+			{
+				result = ::sendmsg(_socket, &message, sendFlags);
+			} while (result == -1 && errno == EINTR);
+
+			if (result == -1)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					break;
+				}
+				disconnect();
+				return sent > 0 ? static_cast<int>(sent) : -1;
+			}
+
+			sent += static_cast<size_t>(result);
+			if (static_cast<size_t>(result) < total)
+			{
+				break;
+			}
+			buffers += batch;
+			count -= batch;
+		}
+		return static_cast<int>(sent);
+	}
+	int64_t sendFile(const File& file, uint64_t offset, uint64_t size) override
+	{
+		auto bsdFile = dynamic_cast<const BSDFile*>(&file);
+		if (!bsdFile)
+		{
+			return ClientSocket::sendFile(file, offset, size);
+		}
+		if (_disconnected)
+		{
+			return -1;
+		}
+		int64_t sent = 0;
+		while (static_cast<uint64_t>(sent) < size)
+		{
+			// kernel copies file pages directly to socket
+			auto chunk = std::min<uint64_t>(size - sent, maxFileChunk);
+#if defined(__linux__)
+			off_t position = static_cast<off_t>(offset + sent);
+			auto result = ::sendfile(_socket, bsdFile->fd(), &position, static_cast<size_t>(chunk));
+			auto written = result > 0 ? static_cast<int64_t>(result) : 0;
+#else
+			off_t length = static_cast<off_t>(chunk);
+			auto result = ::sendfile(bsdFile->fd(), _socket, static_cast<off_t>(offset + sent), &length, nullptr, 0);
+			// partial write is reported through length also when call fails with EAGAIN
+			auto written = static_cast<int64_t>(length);
+#endif
+			sent += written;
+			if (result == -1)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					break;
+				}
+				peq::log::error("[BSDSOCKET] sendfile failed: " + errorString());
+				disconnect();
+				return sent > 0 ? sent : -1;
+			}
+			if (written == 0)
+			{
+				// file is shorter than range, zero would be taken for full socket
+				peq::log::error("[BSDSOCKET] sendfile reached end of file before end of range");
+				return sent > 0 ? sent : -1;
+			}
+		}
+		return sent;
+	}
+	SocketInfo info() const override
+	{
+		sockaddr_storage ci = {};
+		socklen_t len = sizeof(ci);
+		getpeername(_socket, (sockaddr*)&ci, &len);
+		SocketInfo i;
+		i.port = 0;
+		if (ci.ss_family == AF_INET)
+		{
+			char address[INET_ADDRSTRLEN] = { 0 };
+			in_addr ip4 = reinterpret_cast<const sockaddr_in*>(&ci)->sin_addr;
+			i.port = ntohs(reinterpret_cast<const sockaddr_in*>(&ci)->sin_port);
+			inet_ntop(AF_INET, &ip4, address, sizeof(address));
+			i.address = address;
+		}
+		else if (ci.ss_family == AF_INET6)
+		{
+			char address[INET6_ADDRSTRLEN] = { 0 };
+			in6_addr addr = reinterpret_cast<const sockaddr_in6*>(&ci)->sin6_addr;
+			i.port = ntohs(reinterpret_cast<const sockaddr_in6*>(&ci)->sin6_port);
+			unsigned char* bytes = reinterpret_cast<unsigned char*>(&addr);
+			if (IN6_IS_ADDR_V4MAPPED(&addr))
+			{
+				snprintf(address, sizeof(address), "%d.%d.%d.%d", bytes[12], bytes[13], bytes[14], bytes[15]);
+			}
+			else
+			{
+				inet_ntop(AF_INET6, &addr, address, sizeof(address));
+			}
+			i.address = address;
+		}
+		return i;
+	}
+private:
+	static constexpr unsigned maxVectors = 64;
+	static constexpr uint64_t maxFileChunk = 1024 * 1024 * 1024;
+	unsigned _id = 0;
+	int _socket = -1;
+	SocketMode _mode;
+	bool _disconnected;
+};
+
+class BSDServerSocket : public ServerSocket
+{
+public:
+	BSDServerSocket(int port, SocketMode mode, bool reusePort) : _id(0), _mode(mode)
+	{
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_flags = AI_PASSIVE;
+
+		{
+			auto p = std::to_string(port);
+			auto result = getaddrinfo(NULL, p.c_str(), &hints, &_info);
+			if (result != 0) {
+				peq::log::error("[BSDSERVER] getaddrinfo failed: " + std::string(gai_strerror(result)));
+				return;
+			}
+		}
+
+		_socket = ::socket(_info->ai_family, _info->ai_socktype, _info->ai_protocol);
+		if (_socket == -1)
+		{
+			peq::log::error("[BSDSERVER] socket failed with error: " + errorString());
+			return;
+		}
+		_id = static_cast<unsigned>(_socket);
+		fcntl(_socket, F_SETFD, FD_CLOEXEC);
+
+		if (!setNonBlocking(_socket, mode == SocketMode::NonBlocking))
+		{
+			peq::log::error("[BSDSERVER] block/nonblock set error: " + errorString());
+			closeSocket();
+			return;
+		}
+
+		{
+			int v = 1;
+			if (setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &v, sizeof(v)) == -1)
+			{
+				peq::log::error("[BSDSERVER] reuseaddr set error: " + errorString());
+				closeSocket();
+				return;
+			}
+		}
+		if (reusePort)
+		{
+			// kernel balances incoming connections between all sockets bound to the same port
+			int v = 1;
+			if (setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v)) == -1)
+			{
+				peq::log::error("[BSDSERVER] reuseport set error: " + errorString());
+				closeSocket();
+				return;
+			}
+		}
+		if (::bind(_socket, _info->ai_addr, _info->ai_addrlen) == -1)
+		{
+			peq::log::error("[BSDSERVER] bind error: " + errorString());
+			closeSocket();
+			return;
+		}
+		if (::listen(_socket, SOMAXCONN) == -1)
+		{
+			peq::log::error("[BSDSERVER] listen error: " + errorString());
+			closeSocket();
+			return;
+		}
+
+		_ok = true;
+	}
+	ClientSocketRef accept() override
+	{
+		int clientSocket;
+		do
+		{
+#if defined(__linux__)
+			auto flags = SOCK_CLOEXEC | (_mode == SocketMode::NonBlocking ? SOCK_NONBLOCK : 0);
+			clientSocket = ::accept4(_socket, nullptr, nullptr, flags);
+#else
+			clientSocket = ::accept(_socket, nullptr, nullptr);
+#endif
+		} while (clientSocket == -1 && errno == EINTR);
+
+		if (clientSocket == -1)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				peq::log::error("[BSDSERVER] accept failed with error: " + errorString());
+			}
+			return ClientSocketRef();
+		}
+
+#if !defined(__linux__)
+		fcntl(clientSocket, F_SETFD, FD_CLOEXEC);
+		setNonBlocking(clientSocket, _mode == SocketMode::NonBlocking);
+		{
+			int v = 1;
+			setsockopt(clientSocket, SOL_SOCKET, SO_NOSIGPIPE, &v, sizeof(v));
+		}
+#endif
+		return createSocket(clientSocket, _mode);
+	}
+	static ClientSocketRef createSocket(int clientSocket, SocketMode mode)
+	{
+		int v = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v));
+		return ClientSocketRef(new BSDClientSocket(clientSocket, mode));
+	}
+	unsigned accept(std::vector<ClientSocketRef>& sockets, unsigned max) override
+	{
+		if (_mode != SocketMode::NonBlocking)
+		{
+			return ServerSocket::accept(sockets, max);
+		}
+		// non-blocking accept fails with EAGAIN when listen queue is empty
+		unsigned count = 0;
+		while (count < max)
+		{
+			auto socket = accept();
+			if (!socket)
+			{
+				break;
+			}
+			sockets.push_back(socket);
+			count++;
+		}
+		return count;
+	}
+
+	~BSDServerSocket()
+	{
+		if (_info)
+		{
+			freeaddrinfo(_info);
+		}
+		closeSocket();
+	}
+	bool ok() const {
+		return _ok;
+	}
+	unsigned id() const override
+	{
+		return _id;
+	}
+private:
+	void closeSocket()
+	{
+		if (_socket != -1)
+		{
+			::close(_socket);
+			_socket = -1;
+		}
+	}
+	unsigned _id;
+	SocketMode _mode;
+	int _socket = -1;
+	struct addrinfo* _info = nullptr;
+	bool _ok = false;
+};
+
+#if defined(__linux__)
+
+// used by network_backend_uring.cpp for connections accepted through io_uring
+ClientSocketRef peq::network::createClientSocket(int socket)
+{
+	return BSDServerSocket::createSocket(socket, SocketMode::NonBlocking);
+}
+
+// Readiness is tracked by the kernel, so wait() cost depends only on the number of
+// ready sockets, not on the number of sockets registered.
+class EPOLLSelector : public SocketSelector
+{
+public:
+	EPOLLSelector() : SocketSelector()
+	{
+		_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (_epoll == -1)
+		{
+			peq::log::error("[EPOLLSELECTOR] epoll_create1 failed with error: " + errorString());
+			return;
+		}
+
+		_wakeUp = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_wakeUp == -1)
+		{
+			peq::log::error("[EPOLLSELECTOR] eventfd failed with error: " + errorString());
+			return;
+		}
+
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = _wakeUp;
+		if (epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeUp, &ev) == -1)
+		{
+			peq::log::error("[EPOLLSELECTOR] could not add wakeup event:" + errorString());
+		}
+		_events.resize(eventsPerWait);
+	}
+	~EPOLLSelector()
+	{
+		if (_wakeUp != -1) ::close(_wakeUp);
+		if (_epoll != -1) ::close(_epoll);
+	}
+	void add(SocketRef socket) override
+	{
+		auto fd = static_cast<int>(socket->id());
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) == -1)
+		{
+			peq::log::error("[EPOLLSELECTOR] epoll_ctl add failed with error: " + errorString());
+			return;
+		}
+		_sockets[fd] = socket;
+	}
+
+	void remove(SocketRef socket) override
+	{
+		auto fd = static_cast<int>(socket->id());
+		auto it = _sockets.find(fd);
+		if (it == _sockets.end())
+		{
+			return;
+		}
+		_sockets.erase(it);
+		epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	void setWriteInterest(SocketRef socket, bool enabled) override
+	{
+		// epoll_ctl is thread safe and does not touch socket map
+		auto fd = static_cast<int>(socket->id());
+		epoll_event ev = {};
+		ev.events = enabled ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &ev) == -1 && errno != ENOENT)
+		{
+			peq::log::error("[EPOLLSELECTOR] epoll_ctl mod failed with error: " + errorString());
+		}
+	}
+
+	std::vector<SocketRef> wait(unsigned timeoutms) override
+	{
+		std::vector<SocketRef> readyReadSockets;
+
+		int result;
+		do
+		{
+			result = epoll_wait(_epoll, _events.data(), static_cast<int>(_events.size()), static_cast<int>(timeoutms));
+		} while (result == -1 && errno == EINTR);
+
+		if (result < 0)
+		{
+			peq::log::error("[EPOLLSELECTOR] epoll_wait failed with error: " + errorString());
+			return readyReadSockets;
+		}
+
+		readyReadSockets.reserve(result);
+		for (int i = 0; i < result; i++)
+		{
+			auto fd = _events[i].data.fd;
+			if (fd == _wakeUp)
+			{
+				// drain eventfd
+				eventfd_t value;
+				eventfd_read(_wakeUp, &value);
+				continue;
+			}
+			auto s = _sockets.find(fd);
+			if (s == _sockets.end())
+			{
+				continue;
+			}
+			if (auto socket = s->second.lock())
+			{
+				readyReadSockets.push_back(socket);
+			}
+		}
+
+		return readyReadSockets;
+	}
+
+	void wakeUp() override
+	{
+		eventfd_write(_wakeUp, 1);
+	}
+private:
+	static constexpr unsigned eventsPerWait = 256;
+	int _epoll = -1;
+	int _wakeUp = -1;
+	std::vector<epoll_event> _events;
+	std::unordered_map<int, std::weak_ptr<peq::network::Socket>> _sockets;
+};
+
+#else
+
+class POLLSelector : public SocketSelector
+{
+public:
+	POLLSelector() : SocketSelector()
+	{
+		// Self-pipe is used to cancel poll-call
+		if (::pipe(_wakeUp) == -1)
+		{
+			peq::log::error("[POLLSELECTOR] could not create wakeup pipe: " + errorString());
+			_wakeUp[0] = _wakeUp[1] = -1;
+			return;
+		}
+		for (auto fd : _wakeUp)
+		{
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			setNonBlocking(fd, true);
+		}
+	}
+	~POLLSelector()
+	{
+		if (_wakeUp[0] != -1) ::close(_wakeUp[0]);
+		if (_wakeUp[1] != -1) ::close(_wakeUp[1]);
+	}
+	void add(SocketRef socket) override
+	{
+		_sockets.push_back(socket);
+	}
+
+	void remove(SocketRef socket) override
+	{
+		_sockets.erase(std::remove_if(_sockets.begin(), _sockets.end(), [socket](std::weak_ptr<Socket> s)->bool
+		{
+			return socket == s.lock();
+		}), _sockets.end());
+		setWriteInterest(socket, false);
+	}
+
+	void setWriteInterest(SocketRef socket, bool enabled) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(_writeMutex);
+			if (enabled)
+			{
+				_writeInterest.insert(socket->id());
+			}
+			else
+			{
+				_writeInterest.erase(socket->id());
+			}
+		}
+		// poll-call has to be restarted with new events
+		wakeUp();
+	}
+
+	std::vector<SocketRef> wait(unsigned timeoutms) override
+	{
+		std::vector<SocketRef> readyReadSockets;
+
+		std::vector<pollfd> fds;
+		std::vector<SocketRef> sockets;
+		fds.reserve(_sockets.size() + 1);
+		sockets.reserve(_sockets.size());
+		fds.push_back({ _wakeUp[0], POLLIN, 0 });
+		{
+			std::lock_guard<std::mutex> lock(_writeMutex);
+			for (auto it : _sockets)
+			{
+				if (auto s = it.lock())
+				{
+					short events = _writeInterest.count(s->id()) ? (POLLIN | POLLOUT) : POLLIN;
+					fds.push_back({ static_cast<int>(s->id()), events, 0 });
+					sockets.push_back(s);
+				}
+			}
+		}
+
+		auto result = ::poll(fds.data(), fds.size(), static_cast<int>(timeoutms));
+		if (result < 0)
+		{
+			if (errno != EINTR)
+			{
+				peq::log::error("[POLLSELECTOR] poll failed with error: " + errorString());
+			}
+			return readyReadSockets;
+		}
+
+		if (fds[0].revents & POLLIN)
+		{
+			// drain pipe
+			char inBuf[100];
+			while (::read(_wakeUp[0], inBuf, sizeof(inBuf)) > 0) {}
+		}
+
+		for (size_t i = 1; i < fds.size(); i++)
+		{
+			if (fds[i].revents != 0)
+			{
+				readyReadSockets.push_back(sockets[i - 1]);
+			}
+		}
+		return readyReadSockets;
+	}
+
+	void wakeUp() override
+	{
+		char c = 0;
+		auto result = ::write(_wakeUp[1], &c, 1);
+		(void)result;
+	}
+private:
+	int _wakeUp[2];
+	std::vector<std::weak_ptr<peq::network::Socket>> _sockets;
+	std::mutex _writeMutex;
+	std::unordered_set<unsigned> _writeInterest;
+};
+
+#endif
+
 void peq::network::awake()
 {
-	assert(0);
 }
 
 void peq::network::destroy()
 {
-	assert(0);
 }
 
-ServerSocketRef peq::network::createServerSocket(int port)
+ServerSocketRef peq::network::createServerSocket(int port, SocketMode mode, bool reusePort)
+{
+	auto sock = std::shared_ptr<BSDServerSocket>(new BSDServerSocket(port, mode, reusePort));
+	if (!sock->ok())
+	{
+		return std::shared_ptr<ServerSocket>();
+	}
+	return sock;
+}
+
+FileRef peq::network::createFile(const std::string& path)
+{
+	int fd;
+	do
+	{
+		fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1)
+	{
+		peq::log::error("[BSDFILE] failed to open " + path + ": " + errorString());
+		return nullptr;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		peq::log::error("[BSDFILE] not a regular file: " + path);
+		::close(fd);
+		return nullptr;
+	}
+	return std::make_shared<BSDFile>(fd, static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_mtime));
+}
+
+SharedData peq::network::mapFile(const FileRef& file)
 {
-	assert(0);
-	return nullptr;
+	auto bsdFile = std::dynamic_pointer_cast<BSDFile>(file);
+	if (!bsdFile || file->size() == 0)
+	{
+		return SharedData();
+	}
+	auto size = static_cast<size_t>(file->size());
+	auto address = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, bsdFile->fd(), 0);
+	if (address == MAP_FAILED)
+	{
+		peq::log::error("[BSDFILE] mmap failed: " + errorString());
+		return SharedData();
+	}
+	// mapping is released when last response using it is gone
+	SharedData data;
+	data.owner = std::shared_ptr<const void>(address, [size](const void* address) {
+		::munmap(const_cast<void*>(address), size);
+	});
+	data.data = static_cast<const char*>(address);
+	data.size = size;
+	return data;
 }
 
 SocketSelectorRef peq::network::createSocketSelector()
 {
-	assert(0);
-	return nullptr;
+#if defined(__linux__)
+	return SocketSelectorRef(new EPOLLSelector());
+#else
+	return SocketSelectorRef(new POLLSelector());
+#endif
 }
 
+SocketSelectorRef peq::network::createSocketSelector(IOBackend backend)
+{
+	if (backend == IOBackend::IOUring)
+	{
+#if defined(__linux__)
+		if (auto selector = createURINGSelector())
+		{
+			return selector;
+		}
+		peq::log::warning("io_uring is not available, using epoll");
+#else
+		peq::log::warning("io_uring is not available on this platform, using poll");
+#endif
+	}
+	return createSocketSelector();
+}
 
 std::vector<Adapter> peq::network::adapters()
 {
-	assert(0);
 	std::vector<Adapter> adapters;
+
+	struct ifaddrs* addresses = nullptr;
+	if (getifaddrs(&addresses) == -1)
+	{
+		peq::log::error("getifaddrs failed with error: " + errorString());
+		return adapters;
+	}
+
+	std::unordered_map<std::string, Mac> macs;
+	for (auto it = addresses; it != nullptr; it = it->ifa_next)
+	{
+		if (it->ifa_addr == nullptr) continue;
+#if defined(__linux__)
+		if (it->ifa_addr->sa_family == AF_PACKET)
+		{
+			auto ll = reinterpret_cast<const sockaddr_ll*>(it->ifa_addr);
+			Mac mac;
+			mac.length = std::min(size_t(ll->sll_halen), sizeof(mac.bytes));
+			memcpy(mac.bytes, ll->sll_addr, mac.length);
+			macs[it->ifa_name] = mac;
+		}
+#else
+		if (it->ifa_addr->sa_family == AF_LINK)
+		{
+			auto dl = reinterpret_cast<const sockaddr_dl*>(it->ifa_addr);
+			Mac mac;
+			mac.length = std::min(size_t(dl->sdl_alen), sizeof(mac.bytes));
+			memcpy(mac.bytes, LLADDR(dl), mac.length);
+			macs[it->ifa_name] = mac;
+		}
+#endif
+	}
+
+	for (auto it = addresses; it != nullptr; it = it->ifa_next)
+	{
+		if (it->ifa_addr == nullptr || it->ifa_addr->sa_family != AF_INET) continue;
+
+		char address[INET_ADDRSTRLEN] = { 0 };
+		char mask[INET_ADDRSTRLEN] = { 0 };
+		inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(it->ifa_addr)->sin_addr, address, sizeof(address));
+		if (it->ifa_netmask)
+		{
+			inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(it->ifa_netmask)->sin_addr, mask, sizeof(mask));
+		}
+
+		Adapter adapter;
+		adapter.address = address;
+		adapter.name = it->ifa_name;
+		adapter.description = it->ifa_name;
+		adapter.mask = mask;
+		auto mac = macs.find(it->ifa_name);
+		if (mac != macs.end())
+		{
+			adapter.mac = mac->second;
+		}
+		adapters.push_back(adapter);
+	}
+
+	freeifaddrs(addresses);
 	return adapters;
 }
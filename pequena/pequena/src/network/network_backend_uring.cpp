@@ -0,0 +1,1142 @@
+#include "pequena/network/network.h"
+#include "pequena/log.h"
+#include "pequena/time.h"
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+using namespace peq;
+using namespace peq::network;
+
+namespace peq
+{
+	namespace network
+	{
+		ClientSocketRef createClientSocket(int socket); // network_backend_bsd.cpp
+	}
+}
+
+namespace
+{
+	int uringSetup(unsigned entries, io_uring_params* params)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+	}
+
+	int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+	}
+
+	int uringRegister(int fd, unsigned opcode, const void* arg, unsigned args)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, args));
+	}
+
+	std::string errorString(int error)
+	{
+		return std::string(strerror(error));
+	}
+
+	// operation is kept in upper half of user data, socket descriptor in lower half
+	enum class Operation : uint32_t
+	{
+		WakeUp,
+		Accept,
+		Receive,
+		Send,
+		Cancel
+	};
+
+	uint64_t tag(Operation operation, int fd)
+	{
+		return (static_cast<uint64_t>(operation) << 32) | static_cast<uint32_t>(fd);
+	}
+}
+
+class URINGSelector;
+
+// Client socket whose receives and sends are completed by URINGSelector.
+// Received data is read from ring provided buffers and sends are copied to socket send buffer
+// which selector submits on next wait(), so receive and send do not make syscalls.
+class URINGClientSocket : public ClientSocket
+{
+public:
+	URINGClientSocket(ClientSocketRef socket, std::weak_ptr<URINGSelector> selector) : _socket(socket), _selector(selector)
+	{
+		_closing.store(socket->isDisconnected());
+		_closed.store(socket->isDisconnected());
+	}
+	unsigned id() const override
+	{
+		return _socket->id();
+	}
+	int receive(char* data, unsigned dataLength) override;
+	int send(const char* data, unsigned dataLength) override
+	{
+		ConstBuffer buffer = { data, dataLength };
+		return send(&buffer, 1);
+	}
+	int send(const ConstBuffer* buffers, unsigned count) override;
+	int64_t sendFile(const File& file, uint64_t offset, uint64_t size) override;
+	// socket is shut down after queued data has been sent, until then it is not reported disconnected
+	void disconnect() override;
+	bool isDisconnected() const override
+	{
+		return _closed.load();
+	}
+	SocketInfo info() const override
+	{
+		return _socket->info();
+	}
+private:
+	friend class URINGSelector;
+	static constexpr size_t sendLimit = 64 * 1024;
+	static constexpr size_t keptCapacity = 16 * 1024;
+	static constexpr uint64_t closeTimeoutMs = 30000;
+	struct Received
+	{
+		const char* data;
+		unsigned size;
+		uint16_t buffer;
+	};
+	// called with mutex held
+	size_t room() const
+	{
+		return _queued.size() < sendLimit ? sendLimit - _queued.size() : 0;
+	}
+	void queued();
+	ClientSocketRef _socket;
+	std::weak_ptr<URINGSelector> _selector;
+	// sends are refused after disconnect(), socket is closed when output has been sent
+	std::atomic<bool> _closing;
+	std::atomic<bool> _closed;
+	std::mutex _mutex;
+	// receive side, used from thread calling wait()
+	std::deque<Received> _received;
+	unsigned _receivedOffset = 0;
+	bool _eof = false;
+	int _receiveError = 0;
+	// sends are appended to _queued while _sending is owned by kernel
+	Data _queued;
+	Data _sending;
+	size_t _sendingOffset = 0;
+	bool _sendArmed = false;
+	bool _dirty = false;
+	bool _writeInterest = false;
+	bool _closeRequested = false;
+	bool _lingering = false;
+	uint64_t _closeDeadline = 0;
+};
+
+// Listen socket accepting with multishot accept, accepted descriptors are queued until accept() is called
+// from thread calling wait()
+class URINGServerSocket : public ServerSocket
+{
+public:
+	URINGServerSocket(ServerSocketRef socket) : _socket(socket)
+	{
+	}
+	~URINGServerSocket()
+	{
+		for (auto fd : _accepted)
+		{
+			::close(fd);
+		}
+	}
+	unsigned id() const override
+	{
+		return _socket->id();
+	}
+	ClientSocketRef accept() override
+	{
+		if (_accepted.empty())
+		{
+			return ClientSocketRef();
+		}
+		auto fd = _accepted.front();
+		_accepted.pop_front();
+		return createClientSocket(fd);
+	}
+	unsigned accept(std::vector<ClientSocketRef>& sockets, unsigned max) override
+	{
+		unsigned count = 0;
+		while (count < max && !_accepted.empty())
+		{
+			sockets.push_back(accept());
+			count++;
+		}
+		return count;
+	}
+private:
+	friend class URINGSelector;
+	ServerSocketRef _socket;
+	std::deque<int> _accepted;
+};
+
+// Completion based selector on top of io_uring.
+// Listen sockets have multishot accept and client sockets multishot receive into provided buffer ring
+// in the ring. Sends of all sessions owned by one ConnectionTask are queued and submitted together
+// with the wait in a single io_uring_enter call, so steady keep-alive traffic needs one syscall per
+// wait() instead of epoll_wait plus recv and send per socket.
+// Sockets have to be attached to selector before they are added.
+// Ring is used only from the thread calling wait(), sends and write interest changes from other threads
+// are queued and submitted on next wait().
+class URINGSelector : public SocketSelector, public std::enable_shared_from_this<URINGSelector>
+{
+public:
+	URINGSelector() : SocketSelector()
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+		params.cq_entries = completionEntries;
+
+		_ring = uringSetup(submissionEntries, &params);
+		if (_ring == -1)
+		{
+			peq::log::warning("[URINGSELECTOR] io_uring_setup failed with error: " + errorString(errno));
+			return;
+		}
+
+		if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP) || !supported())
+		{
+			peq::log::warning("[URINGSELECTOR] kernel io_uring does not support required features");
+			return;
+		}
+
+		_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+		}
+
+		_sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING);
+		if (_sqRing == MAP_FAILED)
+		{
+			_sqRing = nullptr;
+			peq::log::error("[URINGSELECTOR] could not map submission ring: " + errorString(errno));
+			return;
+		}
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			_cqRing = _sqRing;
+		}
+		else
+		{
+			_cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_CQ_RING);
+			if (_cqRing == MAP_FAILED)
+			{
+				_cqRing = nullptr;
+				peq::log::error("[URINGSELECTOR] could not map completion ring: " + errorString(errno));
+				return;
+			}
+		}
+
+		_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		auto sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+		{
+			peq::log::error("[URINGSELECTOR] could not map submission entries: " + errorString(errno));
+			return;
+		}
+		_sqes = static_cast<io_uring_sqe*>(sqes);
+
+		auto sq = static_cast<char*>(_sqRing);
+		_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		_sqTailPtr = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		_sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+		_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		_sqTail = *_sqTailPtr;
+
+		auto cq = static_cast<char*>(_cqRing);
+		_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		if (!registerBuffers())
+		{
+			return;
+		}
+
+		_wakeUp = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_wakeUp == -1)
+		{
+			peq::log::error("[URINGSELECTOR] eventfd failed with error: " + errorString(errno));
+			return;
+		}
+		armWakeUp();
+
+		_ok = true;
+	}
+	~URINGSelector()
+	{
+		// closing ring cancels requests still in flight
+		if (_ring != -1) ::close(_ring);
+		if (_sqes) munmap(_sqes, _sqesSize);
+		if (_cqRing && _cqRing != _sqRing) munmap(_cqRing, _cqRingSize);
+		if (_sqRing) munmap(_sqRing, _sqRingSize);
+		if (_bufferRing) munmap(_bufferRing, _bufferRingSize);
+		if (_wakeUp != -1) ::close(_wakeUp);
+	}
+	bool ok() const
+	{
+		return _ok;
+	}
+
+	ClientSocketRef attach(ClientSocketRef socket) override
+	{
+		return std::make_shared<URINGClientSocket>(socket, weak_from_this());
+	}
+
+	ServerSocketRef attach(ServerSocketRef socket) override
+	{
+		return std::make_shared<URINGServerSocket>(socket);
+	}
+
+	void add(SocketRef socket) override
+	{
+		auto fd = static_cast<int>(socket->id());
+		Entry entry;
+		entry.client = std::dynamic_pointer_cast<URINGClientSocket>(socket);
+		entry.listener = std::dynamic_pointer_cast<URINGServerSocket>(socket);
+		if (!entry.client && !entry.listener)
+		{
+			peq::log::error("[URINGSELECTOR] socket has not been attached to selector");
+			return;
+		}
+		auto& added = _sockets[fd] = entry;
+		arm(fd, added);
+	}
+
+	void remove(SocketRef socket) override
+	{
+		auto fd = static_cast<int>(socket->id());
+		auto it = _sockets.find(fd);
+		if (it == _sockets.end() || it->second.removed)
+		{
+			return;
+		}
+		auto& entry = it->second;
+		// socket completed earlier in this task loop is no longer reported
+		_ready.erase(std::remove(_ready.begin(), _ready.end(), fd), _ready.end());
+		if (entry.listener)
+		{
+			// accepts completed after cancel are closed when completion is processed
+			if (entry.armed)
+			{
+				cancel(fd, Operation::Accept);
+			}
+			_sockets.erase(it);
+			return;
+		}
+		// entry is kept until kernel no longer uses socket and its send buffer
+		entry.removed = true;
+		_removed.push_back(fd);
+		if (entry.armed)
+		{
+			// canceled receive is collected by next wait(), which releases the socket
+			cancel(fd, Operation::Receive);
+			return;
+		}
+		release();
+	}
+
+	void setWriteInterest(SocketRef socket, bool enabled) override
+	{
+		auto client = std::dynamic_pointer_cast<URINGClientSocket>(socket);
+		if (!client)
+		{
+			return;
+		}
+		bool check = false;
+		{
+			std::lock_guard<std::mutex> lock(client->_mutex);
+			client->_writeInterest = enabled;
+			check = enabled && !client->_dirty;
+			client->_dirty = client->_dirty || enabled;
+		}
+		if (check)
+		{
+			// socket may already have room, wait() reports it without blocking
+			queue(static_cast<int>(client->id()));
+		}
+	}
+
+	std::vector<SocketRef> wait(unsigned timeoutms) override
+	{
+		_owner.store(std::this_thread::get_id());
+
+		// sockets that still have unread data are reported again like with level-triggered epoll
+		for (auto fd : _unread)
+		{
+			auto it = _sockets.find(fd);
+			if (it != _sockets.end() && !it->second.removed)
+			{
+				std::lock_guard<std::mutex> lock(it->second.client->_mutex);
+				if (!it->second.client->_received.empty())
+				{
+					ready(it->second);
+				}
+			}
+		}
+		_unread.clear();
+
+		std::vector<int> dirty;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			dirty.swap(_dirty);
+		}
+		for (auto fd : dirty)
+		{
+			auto it = _sockets.find(fd);
+			if (it != _sockets.end() && it->second.client)
+			{
+				{
+					std::lock_guard<std::mutex> lock(it->second.client->_mutex);
+					it->second.client->_dirty = false;
+				}
+				submitSend(it->second);
+			}
+		}
+
+		// sockets closing after their output has been sent
+		auto now = peq::time::epochMs();
+		_closing.erase(std::remove_if(_closing.begin(), _closing.end(), [this, now](int fd) -> bool {
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end())
+			{
+				return true;
+			}
+			auto& client = *it->second.client;
+			{
+				std::lock_guard<std::mutex> lock(client._mutex);
+				if (client._closed.load())
+				{
+					return true;
+				}
+				if (now <= client._closeDeadline)
+				{
+					return false;
+				}
+				// peer does not read, send in flight fails after shutdown
+				client._queued.clear();
+				client._closed.store(true);
+			}
+			client._socket->disconnect();
+			return true;
+		}), _closing.end());
+
+		// receives and accepts that have ended are started again, starved receives wait for free buffers
+		_rearm.erase(std::remove_if(_rearm.begin(), _rearm.end(), [this](int fd) -> bool {
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end() || it->second.removed || it->second.armed)
+			{
+				return true;
+			}
+			if (it->second.client && _freeBuffers == 0)
+			{
+				return false;
+			}
+			arm(fd, it->second);
+			return true;
+		}), _rearm.end());
+
+		if (!_ready.empty() || completionsReady())
+		{
+			if (_pending > 0)
+			{
+				submit(0, 0, nullptr, 0);
+			}
+		}
+		else
+		{
+			enter(timeoutms);
+		}
+
+		reap();
+		release();
+
+		std::vector<SocketRef> readySockets;
+		readySockets.reserve(_ready.size());
+		for (auto fd : _ready)
+		{
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end() || it->second.removed)
+			{
+				continue;
+			}
+			if (it->second.client)
+			{
+				_unread.push_back(fd);
+				readySockets.push_back(it->second.client);
+			}
+			else
+			{
+				readySockets.push_back(it->second.listener);
+			}
+		}
+		// sockets completed between waits are reported on next wait
+		_ready.clear();
+		_waits++;
+		return readySockets;
+	}
+
+	void wakeUp() override
+	{
+		eventfd_write(_wakeUp, 1);
+	}
+
+	// called by socket when it has new data to send
+	void queue(int fd)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_dirty.push_back(fd);
+		}
+		if (std::this_thread::get_id() != _owner.load())
+		{
+			wakeUp();
+		}
+	}
+
+	// gives consumed receive buffer back to kernel
+	void recycle(uint16_t buffer)
+	{
+		// ring is indexed as plain array, in C++ the flexible array of io_uring_buf_ring is not at offset 0
+		auto& entry = reinterpret_cast<io_uring_buf*>(_bufferRing)[_bufferTail & (bufferCount - 1)];
+		entry.addr = reinterpret_cast<uint64_t>(_buffers.data() + static_cast<size_t>(buffer) * bufferSize);
+		entry.len = bufferSize;
+		entry.bid = buffer;
+		_bufferTail++;
+		__atomic_store_n(&_bufferRing->tail, _bufferTail, __ATOMIC_RELEASE);
+		_freeBuffers++;
+	}
+private:
+	static constexpr unsigned submissionEntries = 256;
+	static constexpr unsigned completionEntries = 8192;
+	static constexpr unsigned bufferCount = 512;
+	static constexpr unsigned bufferSize = 4096;
+	static constexpr uint16_t bufferGroup = 0;
+
+	struct Entry
+	{
+		std::shared_ptr<URINGClientSocket> client;
+		std::shared_ptr<URINGServerSocket> listener;
+		// accept or receive is in ring
+		bool armed = false;
+		bool removed = false;
+		uint64_t reported = 0;
+	};
+
+	bool supported()
+	{
+		// probe is followed by one entry per opcode
+		constexpr unsigned ops = IORING_OP_ASYNC_CANCEL > IORING_OP_RECV ? IORING_OP_ASYNC_CANCEL + 1 : IORING_OP_RECV + 1;
+		std::vector<char> memory(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op), 0);
+		auto probe = reinterpret_cast<io_uring_probe*>(memory.data());
+		if (uringRegister(_ring, IORING_REGISTER_PROBE, probe, ops) != 0)
+		{
+			return false;
+		}
+		for (auto op : { IORING_OP_POLL_ADD, IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_ASYNC_CANCEL })
+		{
+			if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool registerBuffers()
+	{
+		_bufferRingSize = bufferCount * sizeof(io_uring_buf);
+		auto ring = mmap(nullptr, _bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ring == MAP_FAILED)
+		{
+			peq::log::error("[URINGSELECTOR] could not allocate buffer ring: " + errorString(errno));
+			return false;
+		}
+		_bufferRing = static_cast<io_uring_buf_ring*>(ring);
+
+		io_uring_buf_reg reg;
+		memset(&reg, 0, sizeof(reg));
+		reg.ring_addr = reinterpret_cast<uint64_t>(_bufferRing);
+		reg.ring_entries = bufferCount;
+		reg.bgid = bufferGroup;
+		if (uringRegister(_ring, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+		{
+			peq::log::warning("[URINGSELECTOR] kernel does not support provided buffer rings: " + errorString(errno));
+			return false;
+		}
+
+		_buffers.resize(static_cast<size_t>(bufferCount) * bufferSize);
+		for (unsigned i = 0; i < bufferCount; i++)
+		{
+			recycle(static_cast<uint16_t>(i));
+		}
+		return true;
+	}
+
+	// submits queued entries and waits for at least one completion
+	void enter(unsigned timeoutms)
+	{
+		__kernel_timespec ts;
+		ts.tv_sec = timeoutms / 1000;
+		ts.tv_nsec = static_cast<long long>(timeoutms % 1000) * 1000000;
+
+		io_uring_getevents_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = reinterpret_cast<uint64_t>(&ts);
+		submit(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	}
+
+	void reap()
+	{
+		auto head = *_cqHead;
+		auto tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			complete(_cqes[head & _cqMask]);
+		}
+		__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	bool completionsReady() const
+	{
+		return *_cqHead != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+	}
+
+	// reports socket once per wait()
+	void ready(Entry& entry)
+	{
+		if (entry.reported != _waits)
+		{
+			entry.reported = _waits;
+			_ready.push_back(static_cast<int>(entry.client ? entry.client->id() : entry.listener->id()));
+		}
+	}
+
+	void complete(const io_uring_cqe& cqe)
+	{
+		auto operation = static_cast<Operation>(cqe.user_data >> 32);
+		auto fd = static_cast<int>(cqe.user_data & 0xffffffff);
+		bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+		switch (operation)
+		{
+		case Operation::WakeUp:
+		{
+			// drain eventfd
+			eventfd_t value;
+			eventfd_read(_wakeUp, &value);
+			armWakeUp();
+			return;
+		}
+		case Operation::Cancel:
+			return;
+		case Operation::Accept:
+		{
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end() || !it->second.listener)
+			{
+				// listen socket has been removed
+				if (cqe.res >= 0) ::close(cqe.res);
+				return;
+			}
+			auto& entry = it->second;
+			if (cqe.res >= 0)
+			{
+				entry.listener->_accepted.push_back(cqe.res);
+				ready(entry);
+			}
+			else if (cqe.res != -ECANCELED)
+			{
+				peq::log::error("[URINGSELECTOR] accept failed with error: " + errorString(-cqe.res));
+			}
+			if (!more)
+			{
+				entry.armed = false;
+				_rearm.push_back(fd);
+			}
+			return;
+		}
+		case Operation::Receive:
+		{
+			bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+			auto buffer = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			if (hasBuffer)
+			{
+				_freeBuffers--;
+			}
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end() || it->second.removed)
+			{
+				if (hasBuffer) recycle(buffer);
+				if (it != _sockets.end() && !more) it->second.armed = false;
+				return;
+			}
+			auto& entry = it->second;
+			auto& client = *entry.client;
+			bool rearm = !more;
+			if (cqe.res > 0 && hasBuffer)
+			{
+				std::lock_guard<std::mutex> lock(client._mutex);
+				client._received.push_back({ _buffers.data() + static_cast<size_t>(buffer) * bufferSize, static_cast<unsigned>(cqe.res), buffer });
+			}
+			else
+			{
+				if (hasBuffer) recycle(buffer);
+				if (cqe.res == -EINVAL && _multishotReceive)
+				{
+					// kernel older than 6.0, receive is started again after every completion
+					_multishotReceive = false;
+				}
+				else if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -EINTR && cqe.res != -EAGAIN))
+				{
+					std::lock_guard<std::mutex> lock(client._mutex);
+					client._eof = cqe.res == 0;
+					client._receiveError = cqe.res < 0 ? -cqe.res : 0;
+					rearm = false;
+				}
+			}
+			if (!more)
+			{
+				entry.armed = false;
+				if (rearm)
+				{
+					_rearm.push_back(fd);
+				}
+			}
+			ready(entry);
+			return;
+		}
+		case Operation::Send:
+		{
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end())
+			{
+				return;
+			}
+			auto& entry = it->second;
+			auto& client = *entry.client;
+			bool failed = false;
+			{
+				std::lock_guard<std::mutex> lock(client._mutex);
+				client._sendArmed = false;
+				if (cqe.res >= 0)
+				{
+					client._sendingOffset += static_cast<size_t>(cqe.res);
+				}
+				else if (cqe.res != -EINTR && cqe.res != -EAGAIN)
+				{
+					if (cqe.res != -EPIPE && cqe.res != -ECONNRESET)
+					{
+						peq::log::error("[URINGSELECTOR] send failed with error: " + errorString(-cqe.res));
+					}
+					// rest of output can not be delivered
+					client._queued.clear();
+					client._sending.clear();
+					client._sendingOffset = 0;
+					client._closing.store(true);
+					failed = !client._closed.exchange(true);
+				}
+			}
+			if (failed)
+			{
+				client._socket->disconnect();
+			}
+			submitSend(entry);
+			if (!entry.removed)
+			{
+				std::lock_guard<std::mutex> lock(client._mutex);
+				if (client._writeInterest && client.room() > 0)
+				{
+					ready(entry);
+				}
+			}
+			return;
+		}
+		}
+	}
+
+	// submits next part of socket output when there is no send in flight
+	void submitSend(Entry& entry)
+	{
+		auto& client = *entry.client;
+		bool shutdown = false;
+		{
+			std::lock_guard<std::mutex> lock(client._mutex);
+			if (client._closeRequested && !client._closed.load() && !client._lingering)
+			{
+				// close timeout is checked on every wait()
+				client._lingering = true;
+				_closing.push_back(static_cast<int>(client.id()));
+			}
+			if (client._sendArmed)
+			{
+				return;
+			}
+			if (client._sendingOffset >= client._sending.size())
+			{
+				client._sending.clear();
+				client._sendingOffset = 0;
+				client._sending.swap(client._queued);
+				if (client._queued.capacity() > URINGClientSocket::keptCapacity)
+				{
+					Data().swap(client._queued);
+				}
+			}
+			if (client._sending.empty())
+			{
+				shutdown = client._closeRequested && !client._closed.load();
+				if (shutdown)
+				{
+					client._closed.store(true);
+				}
+			}
+			else
+			{
+				auto sqe = nextSqe();
+				sqe->opcode = IORING_OP_SEND;
+				sqe->fd = static_cast<int>(client.id());
+				sqe->addr = reinterpret_cast<uint64_t>(client._sending.data() + client._sendingOffset);
+				sqe->len = static_cast<uint32_t>(client._sending.size() - client._sendingOffset);
+				sqe->msg_flags = MSG_NOSIGNAL;
+				sqe->user_data = tag(Operation::Send, static_cast<int>(client.id()));
+				client._sendArmed = true;
+			}
+			if (!entry.removed && client._writeInterest && client.room() > 0)
+			{
+				ready(entry);
+			}
+		}
+		if (shutdown)
+		{
+			// all output has been sent
+			client._socket->disconnect();
+		}
+	}
+
+	void arm(int fd, Entry& entry)
+	{
+		auto sqe = nextSqe();
+		sqe->fd = fd;
+		if (entry.listener)
+		{
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+			sqe->user_data = tag(Operation::Accept, fd);
+		}
+		else
+		{
+			sqe->opcode = IORING_OP_RECV;
+			sqe->ioprio = _multishotReceive ? IORING_RECV_MULTISHOT : 0;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = bufferGroup;
+			sqe->user_data = tag(Operation::Receive, fd);
+		}
+		entry.armed = true;
+	}
+
+	void armWakeUp()
+	{
+		auto sqe = nextSqe();
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = _wakeUp;
+		sqe->poll32_events = POLLIN;
+		sqe->user_data = tag(Operation::WakeUp, _wakeUp);
+	}
+
+	void cancel(int fd, Operation operation)
+	{
+		auto sqe = nextSqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = tag(operation, fd);
+		sqe->user_data = tag(Operation::Cancel, fd);
+	}
+
+	// drops removed sockets that kernel no longer uses
+	void release()
+	{
+		if (_removed.empty())
+		{
+			return;
+		}
+		_removed.erase(std::remove_if(_removed.begin(), _removed.end(), [this](int fd) -> bool {
+			auto it = _sockets.find(fd);
+			if (it == _sockets.end())
+			{
+				return true;
+			}
+			auto& client = *it->second.client;
+			std::lock_guard<std::mutex> lock(client._mutex);
+			if (it->second.armed || client._sendArmed)
+			{
+				return false;
+			}
+			for (; !client._received.empty(); client._received.pop_front())
+			{
+				recycle(client._received.front().buffer);
+			}
+			_ready.erase(std::remove(_ready.begin(), _ready.end(), fd), _ready.end());
+			_sockets.erase(it);
+			return true;
+		}), _removed.end());
+	}
+
+	io_uring_sqe* nextSqe()
+	{
+		if (_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+		{
+			// ring is full, let kernel consume queued entries
+			submit(0, 0, nullptr, 0);
+		}
+		auto index = _sqTail & _sqMask;
+		auto sqe = &_sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		_sqArray[index] = index;
+		_sqTail++;
+		_pending++;
+		return sqe;
+	}
+
+	void submit(unsigned minComplete, unsigned flags, const void* arg, size_t argSize)
+	{
+		__atomic_store_n(_sqTailPtr, _sqTail, __ATOMIC_RELEASE);
+		int result;
+		do
+		{
+			result = uringEnter(_ring, _pending, minComplete, flags, arg, argSize);
+		} while (result == -1 && errno == EINTR && _pending > 0 && minComplete == 0);
+
+		if (result >= 0)
+		{
+			_pending -= std::min(_pending, static_cast<unsigned>(result));
+		}
+		else if (errno != ETIME && errno != EINTR && errno != EBUSY)
+		{
+			peq::log::error("[URINGSELECTOR] io_uring_enter failed with error: " + errorString(errno));
+		}
+	}
+
+	int _ring = -1;
+	int _wakeUp = -1;
+	bool _ok = false;
+	bool _multishotReceive = true;
+
+	void* _sqRing = nullptr;
+	void* _cqRing = nullptr;
+	size_t _sqRingSize = 0;
+	size_t _cqRingSize = 0;
+	size_t _sqesSize = 0;
+
+	unsigned* _sqHead = nullptr;
+	unsigned* _sqTailPtr = nullptr;
+	unsigned* _sqArray = nullptr;
+	unsigned _sqMask = 0;
+	unsigned _sqEntries = 0;
+	unsigned _sqTail = 0;
+	unsigned _pending = 0;
+	io_uring_sqe* _sqes = nullptr;
+
+	unsigned* _cqHead = nullptr;
+	unsigned* _cqTail = nullptr;
+	unsigned _cqMask = 0;
+	io_uring_cqe* _cqes = nullptr;
+
+	io_uring_buf_ring* _bufferRing = nullptr;
+	size_t _bufferRingSize = 0;
+	uint16_t _bufferTail = 0;
+	unsigned _freeBuffers = 0;
+	std::vector<char> _buffers;
+
+	uint64_t _waits = 1;
+	std::atomic<std::thread::id> _owner;
+	std::mutex _mutex;
+	std::vector<int> _dirty;
+	std::vector<int> _rearm;
+	std::vector<int> _removed;
+	std::vector<int> _closing;
+	std::vector<int> _ready;
+	std::vector<int> _unread;
+	std::unordered_map<int, Entry> _sockets;
+};
+
+int URINGClientSocket::receive(char* data, unsigned dataLength)
+{
+	auto selector = _selector.lock();
+	bool eof = false;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_received.empty())
+		{
+			if (!_eof && _receiveError == 0)
+			{
+				// nothing received yet, same as EAGAIN
+				return -1;
+			}
+			eof = _eof;
+		}
+		else
+		{
+			unsigned copied = 0;
+			while (copied < dataLength && !_received.empty())
+			{
+				auto& front = _received.front();
+				auto chunk = std::min(dataLength - copied, front.size - _receivedOffset);
+				memcpy(data + copied, front.data + _receivedOffset, chunk);
+				copied += chunk;
+				_receivedOffset += chunk;
+				if (_receivedOffset == front.size)
+				{
+					if (selector) selector->recycle(front.buffer);
+					_received.pop_front();
+					_receivedOffset = 0;
+				}
+			}
+			return static_cast<int>(copied);
+		}
+	}
+	// peer closed connection or receive failed
+	disconnect();
+	return eof ? 0 : -1;
+}
+
+int URINGClientSocket::send(const ConstBuffer* buffers, unsigned count)
+{
+	if (_closing.load())
+	{
+		return -1;
+	}
+	size_t sent = 0;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto room = this->room();
+		for (unsigned i = 0; i < count && room > 0; i++)
+		{
+			auto chunk = std::min(buffers[i].size, room);
+			_queued.insert(_queued.end(), buffers[i].data, buffers[i].data + chunk);
+			sent += chunk;
+			room -= chunk;
+		}
+	}
+	if (sent > 0)
+	{
+		queued();
+	}
+	return static_cast<int>(sent);
+}
+
+int64_t URINGClientSocket::sendFile(const File& file, uint64_t offset, uint64_t size)
+{
+	if (_closing.load())
+	{
+		return -1;
+	}
+	int64_t read = 0;
+	{
+		// file is read directly to send buffer
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto chunk = static_cast<size_t>(std::min<uint64_t>(size, room()));
+		if (chunk == 0)
+		{
+			return 0;
+		}
+		auto end = _queued.size();
+		_queued.resize(end + chunk);
+		read = file.read(_queued.data() + end, chunk, offset);
+		_queued.resize(end + static_cast<size_t>(std::max<int64_t>(read, 0)));
+	}
+	if (read <= 0)
+	{
+		// file is shorter than range, zero would be taken for full socket
+		peq::log::error("[URINGSOCKET] failed to read file for sending");
+		return -1;
+	}
+	queued();
+	return read;
+}
+
+void URINGClientSocket::disconnect()
+{
+	bool shutdown = false;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_closing.store(true);
+		if (_closeRequested)
+		{
+			return;
+		}
+		_closeRequested = true;
+		_closeDeadline = peq::time::epochMs() + closeTimeoutMs;
+		shutdown = !_sendArmed && _queued.empty() && _sendingOffset >= _sending.size();
+		if (shutdown)
+		{
+			_closed.store(true);
+		}
+	}
+	if (shutdown)
+	{
+		_socket->disconnect();
+	}
+	else
+	{
+		// selector closes socket when output has been sent
+		queued();
+	}
+}
+
+void URINGClientSocket::queued()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_dirty)
+		{
+			return;
+		}
+		_dirty = true;
+	}
+	if (auto selector = _selector.lock())
+	{
+		selector->queue(static_cast<int>(id()));
+	}
+}
+
+namespace peq
+{
+	namespace network
+	{
+		// used by network_backend_bsd.cpp, returns nullptr when io_uring can not be used
+		SocketSelectorRef createURINGSelector()
+		{
+			auto selector = std::shared_ptr<URINGSelector>(new URINGSelector());
+			if (!selector->ok())
+			{
+				return SocketSelectorRef();
+			}
+			return selector;
+		}
+	}
+}
@@ -3,6 +3,9 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
+#include <filesystem>
+#include <mutex>
+#include <unordered_set>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
@@ -40,6 +43,47 @@ namespace
 	}
 }
 
+// sockets send it with ClientSocket::sendFile chunked read, TransmitFile does not fit non-blocking sockets
+class WINFile : public File
+{
+public:
+	WINFile(HANDLE handle, uint64_t size, uint64_t modified) : _handle(handle), _size(size), _modified(modified)
+	{
+	}
+	~WINFile()
+	{
+		CloseHandle(_handle);
+	}
+	uint64_t size() const override
+	{
+		return _size;
+	}
+	HANDLE handle() const
+	{
+		return _handle;
+	}
+	uint64_t modified() const override
+	{
+		return _modified;
+	}
+	int64_t read(char* data, size_t dataLength, uint64_t offset) const override
+	{
+		OVERLAPPED overlapped = { 0 };
+		overlapped.Offset = static_cast<DWORD>(offset & 0xffffffff);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD read = 0;
+		if (!ReadFile(_handle, data, static_cast<DWORD>(dataLength), &read, &overlapped))
+		{
+			return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+		}
+		return static_cast<int64_t>(read);
+	}
+private:
+	HANDLE _handle;
+	uint64_t _size;
+	uint64_t _modified;
+};
+
 class WINSOCKClientSocket : public ClientSocket
 {
 public:
@@ -93,26 +137,27 @@ public:
 	{
 		int sent = 0;
 		int left = dataLength;
-		do
+		while (left > 0)
 		{
-			auto result = ::send(_socket, (char*)data + dataLength - left, left, 0);
-			if (result > 0) {
+			auto result = ::send(_socket, data + sent, left, 0);
+			if (result > 0)
+			{
 				left -= result;
 				sent += result;
+				continue;
 			}
-			if (result == SOCKET_ERROR) {
-				auto error = WSAGetLastError();
-				if (_mode == SocketMode::NonBlocking && error != WSAEWOULDBLOCK)
-				{
-					if (error == WSAECONNRESET || error == WSAECONNABORTED)
-					{
-						_socket = INVALID_SOCKET;
-					}
-					return -1;
-				}
+			auto error = WSAGetLastError();
+			if (error == WSAEWOULDBLOCK)
+			{
+				// socket buffer is full, Session keeps the rest until selector reports socket writable
+				break;
 			}
-		} while (left > 0);
-
+			if (error == WSAECONNRESET || error == WSAECONNABORTED)
+			{
+				_socket = INVALID_SOCKET;
+			}
+			return -1;
+		}
 		return sent;
 	}
 	SocketInfo info() const
@@ -314,14 +359,23 @@ public:
 		tv.tv_sec = 0;
 
 		fd_set readFds;
+		fd_set writeFds;
 		FD_ZERO(&readFds);
+		FD_ZERO(&writeFds);
 		std::map<SOCKET, SocketRef> socketMap;
-		for (auto it : _sockets)
 		{
-			auto s = it.lock();
-			FD_SET( (SOCKET)s->id(), &readFds);
+			std::lock_guard<std::mutex> lock(_writeMutex);
+			for (auto it : _sockets)
+			{
+				auto s = it.lock();
+				FD_SET( (SOCKET)s->id(), &readFds);
+				if (_writeInterest.count(s->id()))
+				{
+					FD_SET((SOCKET)s->id(), &writeFds);
+				}
 
-			socketMap[(SOCKET)s->id()] = s;
+				socketMap[(SOCKET)s->id()] = s;
+			}
 		}
 
 		if (_cancelUdpSocket != INVALID_SOCKET)
@@ -329,7 +383,7 @@ public:
 			FD_SET(_cancelUdpSocket, &readFds);
 		}
 
-		auto result = select(readFds.fd_count, &readFds, nullptr, nullptr, &tv);
+		auto result = select(readFds.fd_count, &readFds, &writeFds, nullptr, &tv);
 		if (result < 0) {
 			peq::log::error("[WINSOCKSELECTOR] select failed with error:" + peq::string::from(WSAGetLastError()));
 			return readyReadSockets;
@@ -360,6 +414,19 @@ public:
 				}
 			}
 		}
+		for (unsigned i = 0; i < writeFds.fd_count; i++)
+		{
+			// writable socket that was also readable is already reported
+			if (FD_ISSET(writeFds.fd_array[i], &readFds))
+			{
+				continue;
+			}
+			auto s = socketMap.find(writeFds.fd_array[i]);
+			if (s != socketMap.end())
+			{
+				readyReadSockets.push_back(s->second);
+			}
+		}
 
 		return readyReadSockets;
 	}
@@ -368,7 +435,25 @@ public:
 		_sockets.erase(std::remove_if(_sockets.begin(), _sockets.end(), [socket](std::weak_ptr<Socket> s)->bool
 		{
 			return socket == s.lock();
-		}));
+		}), _sockets.end());
+		setWriteInterest(socket, false);
+	}
+
+	void setWriteInterest(SocketRef socket, bool enabled) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(_writeMutex);
+			if (enabled)
+			{
+				_writeInterest.insert(socket->id());
+			}
+			else
+			{
+				_writeInterest.erase(socket->id());
+			}
+		}
+		// select-call has to be restarted with new write set
+		wakeUp();
 	}
 
 	void wakeUp() override
@@ -380,6 +465,8 @@ private:
 
 	std::vector<std::weak_ptr<peq::network::Socket>> _sockets;
 	SOCKET _cancelUdpSocket;
+	std::mutex _writeMutex;
+	std::unordered_set<unsigned> _writeInterest;
 };
 
 void peq::network::awake()
@@ -392,8 +479,14 @@ void peq::network::destroy()
 	cleanupWinsock();
 }
 
-ServerSocketRef peq::network::createServerSocket(int port, SocketMode mode)
+ServerSocketRef peq::network::createServerSocket(int port, SocketMode mode, bool reusePort)
 {
+	if (reusePort)
+	{
+		// SO_REUSEPORT load balancing is not available in winsock
+		peq::log::warning("[WINSOCKSERVER] reuseport is not supported");
+		return std::shared_ptr<ServerSocket>();
+	}
 	auto sock = std::shared_ptr<WINSOCKServerSocket>( new WINSOCKServerSocket(port, mode) );
 	if (!sock->ok())
 	{
@@ -402,11 +495,81 @@ ServerSocketRef peq::network::createServerSocket(int port, SocketMode mode)
 	return sock;
 }
 
+FileRef peq::network::createFile(const std::string& path)
+{
+	auto widePath = std::filesystem::u8path(path).wstring();
+	auto handle = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		peq::log::error("[WINFILE] failed to open " + path + ": " + peq::string::from(GetLastError()));
+		return nullptr;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size))
+	{
+		peq::log::error("[WINFILE] failed to get size of " + path);
+		CloseHandle(handle);
+		return nullptr;
+	}
+	FILETIME writeTime;
+	if (!GetFileTime(handle, nullptr, nullptr, &writeTime))
+	{
+		peq::log::error("[WINFILE] failed to get modification time of " + path);
+		CloseHandle(handle);
+		return nullptr;
+	}
+	// FILETIME counts 100ns intervals since 1601
+	ULARGE_INTEGER ticks;
+	ticks.LowPart = writeTime.dwLowDateTime;
+	ticks.HighPart = writeTime.dwHighDateTime;
+	auto modified = ticks.QuadPart / 10000000ULL - 11644473600ULL;
+	return std::make_shared<WINFile>(handle, static_cast<uint64_t>(size.QuadPart), modified);
+}
+
+SharedData peq::network::mapFile(const FileRef& file)
+{
+	auto winFile = std::dynamic_pointer_cast<WINFile>(file);
+	if (!winFile || file->size() == 0)
+	{
+		return SharedData();
+	}
+	auto mapping = CreateFileMappingW(winFile->handle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		peq::log::error("[WINFILE] CreateFileMapping failed: " + peq::string::from(GetLastError()));
+		return SharedData();
+	}
+	auto address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	// view keeps mapping object alive
+	CloseHandle(mapping);
+	if (address == nullptr)
+	{
+		peq::log::error("[WINFILE] MapViewOfFile failed: " + peq::string::from(GetLastError()));
+		return SharedData();
+	}
+	SharedData data;
+	data.owner = std::shared_ptr<const void>(address, [](const void* address) {
+		UnmapViewOfFile(address);
+	});
+	data.data = static_cast<const char*>(address);
+	data.size = static_cast<size_t>(file->size());
+	return data;
+}
+
 SocketSelectorRef peq::network::createSocketSelector()
 {
 	return SocketSelectorRef(new WINSOCKESelector());
 }
 
+SocketSelectorRef peq::network::createSocketSelector(IOBackend backend)
+{
+	if (backend == IOBackend::IOUring)
+	{
+		peq::log::warning("[WINSOCKSELECTOR] io_uring is not available on this platform, using select");
+	}
+	return createSocketSelector();
+}
+
 
 std::vector<Adapter> peq::network::adapters()
 {